@@ -0,0 +1,185 @@
+//
+//  bench_batch_events.cpp
+//  BDmodel
+//
+//  Per-event calls versus the batched updates of LineageTree
+//  ('addExtantLineages', 'sampleExtantLineages', 'removeExtantLineages')
+//  on a tau-leaping Birth & Death epidemic: every step of length 'tau'
+//  draws a block of transmissions, then a block of removals (some of them
+//  sampled). The epidemic is critical (R0 = 1) and starts from 'nseeds'
+//  introductions, hence blocks hold about 2 * tau * nseeds events. Both
+//  variants replay the exact same blocks, for a counter identifier (dense
+//  index) and a two-integer identifier (hash index).
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct LineageInfo {
+
+    LineageInfo( const int& host_id_ = -1, const int& strain_id_ = -1 ) : host_id( host_id_ ), strain_id( strain_id_ ) {} ;
+    int host_id ;
+    int strain_id ;
+
+    bool operator==(const LineageInfo& other) const { return host_id == other.host_id && strain_id == other.strain_id ; }
+
+} ;
+
+namespace std {
+    template<>
+    struct hash<LineageInfo> {
+        std::size_t operator()(const LineageInfo& li) const noexcept {
+            std::size_t h1 = std::hash<int>()(li.host_id);
+            std::size_t h2 = std::hash<int>()(li.strain_id);
+            return h1 ^ (h2 << 1);
+        }
+    };
+}
+
+std::string lng2string( const LineageInfo& lng ) { return std::to_string( lng.host_id ) + "-" + std::to_string( lng.strain_id ) ; }
+
+template <typename T> T makeID( int n ) ;
+template <> int makeID<int>( int n ) { return n ; }
+template <> LineageInfo makeID<LineageInfo>( int n ) { return LineageInfo( n, n % 7 ) ; }
+
+/*
+ Blocks of events of a tau-leaping BD epidemic (beta = mu = 1), generated
+ once. The first block introduces 'nseeds' lineages.
+ */
+template <typename T>
+struct Block {
+
+    double t ;
+    std::vector<T> introductions ;
+    std::vector<BirthEvent<T,int>> births ;
+    std::vector<SamplingEvent<T>> samples ;
+    std::vector<T> removals ;
+
+} ;
+
+template <typename T>
+std::vector<Block<T>> makeBlocks( int nseeds, int ncases, double tau, double rho, int seed ) {
+
+    m_mt.seed( seed ) ;
+
+    std::vector<Block<T>> blocks ;
+    std::vector<T> I ;
+    double t = 0. ;
+    int next = 1 ;
+
+    while ( next <= ncases and ( next == 1 or !I.empty() ) ) {
+
+        Block<T> block ;
+        block.t = t ;
+        for ( ; next <= nseeds; ++next ) {
+            block.introductions.push_back( makeID<T>( next ) ) ;
+            I.push_back( makeID<T>( next ) ) ;
+        }
+
+        int nI = static_cast<int>( I.size() ) ;
+        int nbirths = getBinom( tau, nI ) ; // transmissions (beta = 1)
+        for ( int i = 0; i < nbirths; ++i ) {
+            block.births.push_back( BirthEvent<T,int>( t, makeID<T>( next ), I[getUniInt( nI - 1 )], 0 ) ) ;
+            I.push_back( makeID<T>( next++ ) ) ;
+        }
+
+        int nremovals = getBinom( tau, static_cast<int>( I.size() ) ) ; // removals (mu = 1)
+        for ( int i = 0; i < nremovals; ++i ) {
+            int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+            if ( getBool( rho ) )
+                block.samples.push_back( SamplingEvent<T>( I[ix], t ) ) ;
+            block.removals.push_back( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+        blocks.push_back( block ) ;
+        t += tau ;
+
+    }
+
+    return blocks ;
+
+}
+
+template <class Tree, typename T>
+double replay( const std::vector<Block<T>>& blocks, bool batched, std::string& nwk ) {
+
+    Tree tree ;
+
+    auto t0 = std::chrono::steady_clock::now() ;
+    for ( const Block<T>& block : blocks ) {
+
+        for ( const T& lng : block.introductions )
+            tree.addExtantLineageExternal( block.t, lng, 0 ) ;
+
+        if ( batched ) {
+            tree.addExtantLineages( block.births ) ;
+            tree.sampleExtantLineages( block.samples ) ;
+            tree.removeExtantLineages( block.removals ) ;
+        }
+        else {
+            for ( const BirthEvent<T,int>& ev : block.births )
+                tree.addExtantLineage( ev.t, ev.lng, ev.data, ev.lngParent ) ;
+            for ( const SamplingEvent<T>& ev : block.samples )
+                tree.sampleExtantLineage( ev.lng, ev.t, ev.locSample ) ;
+            for ( const T& lng : block.removals )
+                tree.removeExtantLineage( lng ) ;
+        }
+
+    }
+    auto t1 = std::chrono::steady_clock::now() ;
+
+    nwk.clear() ;
+    for ( LineageTreeNode<T,int>* rtree : tree.subSampleTree() ) {
+        PhyloNode<T,int>* atree = getAncestralTree( rtree ) ;
+        nwk += getSimpleNewick( atree ) ;
+        deletePhyloNodeTree( atree ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+
+    return std::chrono::duration<double>( t1 - t0 ).count() ;
+
+}
+
+template <class Tree, typename T>
+void run( const char* name, int nseeds, int ncases, double tau, double rho ) {
+
+    for ( int seed = 1; seed <= 3; ++seed ) {
+
+        std::vector<Block<T>> blocks = makeBlocks<T>( nseeds, ncases, tau, rho, seed ) ;
+        std::size_t nevents = 0 ;
+        for ( const Block<T>& block : blocks )
+            nevents += block.births.size() + block.samples.size() + block.removals.size() ;
+
+        std::string nwkEvent, nwkBatch ;
+        double tEvent = replay<Tree>( blocks, false, nwkEvent ) ;
+        double tBatch = replay<Tree>( blocks, true, nwkBatch ) ;
+
+        std::printf( "%12s %10zu %18.3e %18.3e %8.2f %6s\n", name, nevents, nevents / tEvent, nevents / tBatch, tEvent / tBatch, ( nwkEvent == nwkBatch ) ? "yes" : "NO" ) ;
+
+    }
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 5000000 ;
+    int nseeds = ( argc > 2 ) ? std::atoi( argv[2] ) : 100000 ;
+    double tau = ( argc > 3 ) ? std::atof( argv[3] ) : 0.01 ;
+    double rho = 0.01 ;
+
+    std::printf( "tau-leaping BD model, R0 = 1, tau = %.3f, rho = %.2f, %d seeds, %d cases\n", tau, rho, nseeds, ncases ) ;
+    std::printf( "%12s %10s %18s %18s %8s %6s\n", "identifier", "events", "per-event (ev/s)", "batched (ev/s)", "speedup", "same" ) ;
+
+    run< LineageTree<int,int>, int >( "int", nseeds, ncases, tau, rho ) ;
+    run< LineageTree<LineageInfo,int>, LineageInfo >( "LineageInfo", nseeds, ncases, tau, rho ) ;
+
+    return 0 ;
+
+}
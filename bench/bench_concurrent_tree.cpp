@@ -0,0 +1,192 @@
+//
+//  bench_concurrent_tree.cpp
+//  BDmodel
+//
+//  Multi-threaded tracking throughput: ConcurrentLineageTree against a
+//  LineageTree behind a single mutex, for 1 to 32 threads. Every thread
+//  simulates the critical Birth & Death epidemics (R0 = 1) of its own
+//  region, re-seeded by an introduction whenever they go extinct; a small
+//  fraction of transmissions infects another region, whose thread then
+//  handles the new lineage (its removal, its own transmissions).
+//  The total number of events is fixed (strong scaling).
+//
+
+#include "concurrent_tree.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+ Baseline: every event is funnelled through one mutex.
+ */
+template <typename T, typename U>
+class LockedLineageTree {
+public:
+
+    void addExtantLineageExternal( const double& t, const T& lng, const U& data, std::size_t ) {
+
+        std::lock_guard<std::mutex> lock( mtx ) ;
+        tree.addExtantLineageExternal( t, lng, data ) ;
+
+    }
+
+    void addExtantLineage( const double& t, const T& lng, const U& data, const T& lngParent ) {
+
+        std::lock_guard<std::mutex> lock( mtx ) ;
+        tree.addExtantLineage( t, lng, data, lngParent ) ;
+
+    }
+
+    void removeExtantLineage( const T& lng ) {
+
+        std::lock_guard<std::mutex> lock( mtx ) ;
+        tree.removeExtantLineage( lng ) ;
+
+    }
+
+    bool sampleExtantLineage( const T& lng, const double& t ) {
+
+        std::lock_guard<std::mutex> lock( mtx ) ;
+        return tree.sampleExtantLineage( lng, t ) ;
+
+    }
+
+    std::vector<LineageTreeNode<T,U>*> subSampleTree() {
+
+        std::lock_guard<std::mutex> lock( mtx ) ;
+        return tree.subSampleTree() ;
+
+    }
+
+private:
+    std::mutex mtx ;
+    LineageTree<T,U,std::hash<T>,HashLineageIndex<T>> tree ;
+
+} ;
+
+struct Region {
+
+    std::mutex mtx ;
+    std::vector<int> inbox ; // lineages infected from other regions
+
+} ;
+
+/*
+ Runs 'nevents' events on 'nthreads' threads; returns events per second
+ and counts the tips of the final trees (to check both trackers agree).
+ */
+template <class Tree>
+double run( int nthreads, long nevents, double pCross, std::size_t& tips, std::size_t& samples ) {
+
+    const double beta = 1., mu = 1., rho = 0.01 ;
+
+    Tree tree ;
+    std::vector<std::unique_ptr<Region>> regions ;
+    for ( int i = 0; i < nthreads; ++i )
+        regions.push_back( std::unique_ptr<Region>( new Region ) ) ;
+    std::atomic<std::size_t> nsampled( 0 ) ;
+
+    auto worker = [&]( int tid ) {
+
+        std::mt19937_64 rng( 12345 + tid ) ;
+        std::uniform_real_distribution<double> uni( 0., 1. ) ;
+        std::vector<int> I ;
+        double t = 0. ;
+        int next = 0 ;
+        auto newID = [&]() { return ( next++ ) * nthreads + tid ; } ; // unique across threads
+        std::size_t mysampled = 0 ;
+
+        for ( long e = 0; e < nevents / nthreads; ++e ) {
+
+            if ( ( e & 63 ) == 0 ) { // collect lineages infected by other regions
+                std::lock_guard<std::mutex> lock( regions[tid]->mtx ) ;
+                I.insert( I.end(), regions[tid]->inbox.begin(), regions[tid]->inbox.end() ) ;
+                regions[tid]->inbox.clear() ;
+            }
+
+            if ( I.empty() ) { // (re-)introduction in the shard of this thread
+                I.push_back( newID() ) ;
+                tree.addExtantLineageExternal( t, I.back(), 0, tid ) ;
+            }
+
+            t += 1e-3 ;
+            std::size_t ix = rng() % I.size() ;
+
+            if ( uni( rng ) * ( beta + mu ) < beta ) { // transmission
+
+                int child = newID() ;
+                tree.addExtantLineage( t, child, 0, I[ix] ) ;
+
+                int dest = ( uni( rng ) < pCross ) ? static_cast<int>( rng() % nthreads ) : tid ;
+                if ( dest == tid )
+                    I.push_back( child ) ;
+                else {
+                    std::lock_guard<std::mutex> lock( regions[dest]->mtx ) ;
+                    regions[dest]->inbox.push_back( child ) ;
+                }
+
+            }
+            else { // removal
+
+                if ( uni( rng ) < rho ) {
+                    tree.sampleExtantLineage( I[ix], t ) ;
+                    ++mysampled ;
+                }
+                tree.removeExtantLineage( I[ix] ) ;
+                I[ix] = I.back() ;
+                I.pop_back() ;
+
+            }
+
+        }
+
+        nsampled += mysampled ;
+
+    } ;
+
+    auto t0 = std::chrono::steady_clock::now() ;
+    std::vector<std::thread> threads ;
+    for ( int tid = 0; tid < nthreads; ++tid )
+        threads.push_back( std::thread( worker, tid ) ) ;
+    for ( std::thread& th : threads )
+        th.join() ;
+    auto t1 = std::chrono::steady_clock::now() ;
+
+    tips = 0 ;
+    for ( LineageTreeNode<int,int>* rtree : tree.subSampleTree() ) {
+        visitPreOrder( rtree, LineageTreeNodeChildren(), [&]( LineageTreeNode<int,int>* node ) { tips += node->sampled ; } ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+    samples = nsampled ;
+
+    return ( nevents / nthreads ) * nthreads / std::chrono::duration<double>( t1 - t0 ).count() ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    long nevents = ( argc > 1 ) ? std::atol( argv[1] ) : 10000000 ;
+    double pCross = ( argc > 2 ) ? std::atof( argv[2] ) : 0.01 ;
+
+    std::printf( "BD model, R0 = 1, %ld events, %.3f of transmissions across regions, %u hardware threads\n", nevents, pCross, std::thread::hardware_concurrency() ) ;
+    std::printf( "%8s %18s %18s %8s %8s\n", "threads", "one mutex (ev/s)", "sharded (ev/s)", "speedup", "tips ok" ) ;
+
+    for ( int nthreads : { 1, 2, 4, 8, 16, 32 } ) {
+
+        std::size_t tipsLocked, samplesLocked, tipsSharded, samplesSharded ;
+        double locked = run< LockedLineageTree<int,int> >( nthreads, nevents, pCross, tipsLocked, samplesLocked ) ;
+        double sharded = run< ConcurrentLineageTree<int,int> >( nthreads, nevents, pCross, tipsSharded, samplesSharded ) ;
+
+        bool ok = ( tipsLocked == samplesLocked ) and ( tipsSharded == samplesSharded ) ;
+        std::printf( "%8d %18.3e %18.3e %8.2f %8s\n", nthreads, locked, sharded, sharded / locked, ok ? "yes" : "NO" ) ;
+
+    }
+
+    return 0 ;
+
+}
@@ -0,0 +1,81 @@
+//
+//  bench_deep_sampling.cpp
+//  BDmodel
+//
+//  Worst case of sampling for the tracker: a single chain of transmissions
+//  where each lineage infects the next one, is sampled, then removed.
+//  Sampled nodes are never pruned, hence the live tree is as deep as the
+//  number of generations. Sampling must not walk up to the root every
+//  time (see 'hasSampled'), otherwise ingestion is quadratic in the number
+//  of generations. Neither may the invalidation of cached snapshots (see
+//  'invalidateSnapshots'), timed by ingesting again after a first snapshot.
+//  Also times the extraction of the (caterpillar) tree, serial and parallel.
+//
+//  Usage: bench_deep_sampling [max generations]
+//
+
+#include "tree.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static double seconds( std::chrono::steady_clock::time_point t0 ) {
+
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+}
+
+/*
+ Runs 'n' generations, after taking a snapshot if 'snapshot' is 'true'; returns the time taken.
+ */
+double ingest( LineageTree<int,int>& tree, int n, bool snapshot ) {
+
+    auto t0 = std::chrono::steady_clock::now() ;
+
+    double t = 0. ;
+    tree.addExtantLineageExternal( t, 0, 0 ) ;
+    if ( snapshot )
+        tree.takeSnapshot( t ) ;
+    for ( int i = 1; i <= n; ++i ) {
+        t += 1. ;
+        tree.addExtantLineage( t, i, 0, i - 1 ) ; // child
+        tree.sampleExtantLineage( i - 1, t ) ; // sample parent
+        tree.removeExtantLineage( i - 1 ) ; // remove parent
+    }
+
+    return seconds( t0 ) ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int maxGenerations = ( argc > 1 ) ? std::atoi( argv[1] ) : 100000 ;
+
+    std::printf( "%12s %12s %14s %16s %14s %14s\n", "generations", "ingest (s)", "ns / sample", "after snapshot", "extract (s)", "4 threads (s)" ) ;
+
+    for ( int n = 1000; n <= maxGenerations; n *= 10 ) {
+
+        LineageTree<int,int> snapshotTree ;
+        double tSnapshot = ingest( snapshotTree, n, true ) ;
+
+        LineageTree<int,int> tree ;
+        double tIngest = ingest( tree, n, false ) ;
+
+        auto t0 = std::chrono::steady_clock::now() ;
+        std::size_t ntrees = ReducedForest<int,int>( tree.subSampleTree() ).size() ;
+        double tSerial = seconds( t0 ) ;
+
+        t0 = std::chrono::steady_clock::now() ;
+        ntrees += ReducedForest<int,int>( tree.subSampleTree( 4, 256 ) ).size() ;
+        double tParallel = seconds( t0 ) ;
+
+        if ( ntrees != 2 )
+            std::printf( "unexpected number of trees: %zu\n", ntrees ) ;
+        std::printf( "%12d %12.4f %14.1f %16.4f %14.4f %14.4f\n", n, tIngest, 1e9 * tIngest / n, tSnapshot, tSerial, tParallel ) ;
+
+    }
+
+    return 0 ;
+
+}
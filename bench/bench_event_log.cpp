@@ -0,0 +1,126 @@
+//
+//  bench_event_log.cpp
+//  BDmodel
+//
+//  Simulates a Birth & Death epidemic (R0 = 1.5) once while recording its
+//  events to a log file, then replays the log into fresh trees: with the
+//  recorded sampling (checking that the trees are identical) and with
+//  alternative sampling probabilities. Replays skip the random draws and
+//  the Gillespie loop of the simulation.
+//
+
+#include "event_log.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+template <class Tree>
+std::string forest( Tree& tree, std::size_t& ntrees ) {
+
+    std::string nwk ;
+    std::vector<LineageTreeNode<int,int>*> rtrees = tree.subSampleTree() ;
+    ntrees = rtrees.size() ;
+    for ( LineageTreeNode<int,int>* rtree : rtrees ) {
+        PhyloNode<int,int>* atree = getAncestralTree( rtree ) ;
+        nwk += getSimpleNewick( atree ) ;
+        deletePhyloNodeTree( atree ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+    return nwk ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 10000000 ;
+    std::string path = ( argc > 2 ) ? argv[2] : "bench_event_log.bin" ;
+    double R0 = 1.5, rho = 0.01 ;
+
+    // simulation (as in 'Simulator'), recording events
+    m_mt.seed( 1 ) ;
+    LineageTree<int,int> tree ;
+    uint64_t nevents ;
+    auto t0 = std::chrono::steady_clock::now() ;
+    {
+        std::ofstream file( path, std::ios::binary | std::ios::trunc ) ;
+        EventLogWriter<int> log( file ) ;
+
+        std::vector<int> I ;
+        double t = 0. ;
+        int next = 1 ;
+        tree.addExtantLineageExternal( t, next, 0 ) ;
+        log.introduction( t, next ) ;
+        I.push_back( next++ ) ;
+
+        while ( next <= ncases and !I.empty() ) {
+
+            double rate = ( R0 + 1. ) * I.size() ;
+            t += getExpo( rate ) ;
+            int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+            if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+                log.transmission( t, next, I[ix] ) ;
+                tree.addExtantLineage( t, next, 0, I[ix] ) ;
+                I.push_back( next++ ) ;
+            }
+            else { // removal
+                if ( getBool( rho ) ) {
+                    tree.sampleExtantLineage( I[ix], t ) ;
+                    log.sampling( t, I[ix] ) ;
+                }
+                log.removal( t, I[ix] ) ;
+                tree.removeExtantLineage( I[ix] ) ;
+                I[ix] = I.back() ;
+                I.pop_back() ;
+            }
+
+        }
+        nevents = log.size() ;
+    }
+    double tSimulation = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+    std::size_t ntrees ;
+    std::string original = forest( tree, ntrees ) ;
+    tree.reset() ;
+
+    MappedFile file ;
+    if ( !file.open( path ) ) {
+        std::printf( "cannot read %s\n", path.c_str() ) ;
+        return 1 ;
+    }
+
+    std::printf( "%d cases, %llu events, log of %.1f MB (%.2f bytes per event)\n", ncases, static_cast<unsigned long long>( nevents ), file.size() / 1e6, static_cast<double>( file.size() ) / nevents ) ;
+    std::printf( "%-22s %10s %14s %8s %8s\n", "run", "time (s)", "events/s", "samples", "same" ) ;
+    std::printf( "%-22s %10.3f %14.3e %8s %8s\n", "simulation", tSimulation, nevents / tSimulation, "-", "-" ) ;
+
+    {
+        auto t1 = std::chrono::steady_clock::now() ;
+        EventLogReader<int> log( file.data(), file.size() ) ;
+        long nsampled = replayEventLog( log, tree ) ;
+        double tReplay = std::chrono::duration<double>( std::chrono::steady_clock::now() - t1 ).count() ;
+        bool same = ( forest( tree, ntrees ) == original ) ;
+        std::printf( "%-22s %10.3f %14.3e %8ld %8s\n", "replay (recorded)", tReplay, nevents / tReplay, nsampled, same ? "yes" : "NO" ) ;
+        tree.reset() ;
+    }
+
+    for ( double p : { 0.001, 0.01, 0.1 } ) {
+
+        auto t1 = std::chrono::steady_clock::now() ;
+        EventLogReader<int> log( file.data(), file.size() ) ;
+        BernoulliSampling rule( p ) ;
+        long nsampled = replayEventLog( log, tree, rule ) ;
+        double tReplay = std::chrono::duration<double>( std::chrono::steady_clock::now() - t1 ).count() ;
+        std::printf( "replay (rho = %5.3f)   %10.3f %14.3e %8ld %8s\n", p, tReplay, nevents / tReplay, nsampled, "-" ) ;
+        tree.reset() ;
+
+    }
+
+    file.close() ;
+    std::remove( path.c_str() ) ;
+    return 0 ;
+
+}
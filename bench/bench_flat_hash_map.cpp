@@ -0,0 +1,115 @@
+//
+//  bench_flat_hash_map.cpp
+//  BDmodel
+//
+//  Add/remove throughput of FlatHashMap/FlatHashSet against the standard
+//  node-based containers, using two-integer lineage identifiers (as in the
+//  LineageInfo example of simulator.hpp) and the churn pattern of a
+//  simulation: new lineages are added while random extant ones are removed.
+//
+
+#include "flat_hash_map.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct LineageInfo {
+
+    LineageInfo( const int& host_id_ = -1, const int& strain_id_ = -1 ) : host_id( host_id_ ), strain_id( strain_id_ ) {} ;
+    int host_id ;
+    int strain_id ;
+
+    bool operator==(const LineageInfo& other) const { return host_id == other.host_id && strain_id == other.strain_id ; }
+
+} ;
+
+namespace std {
+    template<>
+    struct hash<LineageInfo> {
+        std::size_t operator()(const LineageInfo& li) const noexcept {
+            std::size_t h1 = std::hash<int>()(li.host_id);
+            std::size_t h2 = std::hash<int>()(li.strain_id);
+            return h1 ^ (h2 << 1);
+        }
+    };
+}
+
+// thin adaptors so that both container families run the exact same loop
+template <class Map> bool mapInsert( Map& m, const LineageInfo& k, uint32_t v ) { return m.insert( std::make_pair( k, v ) ).second ; }
+template <> bool mapInsert( FlatHashMap<LineageInfo,uint32_t>& m, const LineageInfo& k, uint32_t v ) { return m.insert( k, v ) ; }
+template <class Map> bool mapContains( const Map& m, const LineageInfo& k ) { return m.find( k ) != m.end() ; }
+template <> bool mapContains( const FlatHashMap<LineageInfo,uint32_t>& m, const LineageInfo& k ) { return m.contains( k ) ; }
+template <class Set> bool setContains( const Set& s, const LineageInfo& k ) { return s.find( k ) != s.end() ; }
+template <> bool setContains( const FlatHashSet<LineageInfo>& s, const LineageInfo& k ) { return s.contains( k ) ; }
+
+/*
+ Keeps 'nlive' lineages in 'Map' and performs 'nevents' (insert + lookup + erase) rounds.
+ Every 10th removed lineage is also added to a 'Set' (sampled lineages).
+ Returns events per second.
+ */
+template <class Map, class Set>
+double churn( std::size_t nlive, std::size_t nevents, uint64_t seed ) {
+
+    std::mt19937_64 rng( seed ) ;
+    Map extant ;
+    Set sampled ;
+    std::vector<LineageInfo> live ;
+    live.reserve( nlive ) ;
+
+    int next = 0 ;
+    for ( std::size_t i = 0; i < nlive; ++i, ++next ) {
+        live.push_back( LineageInfo( next, next % 7 ) ) ;
+        mapInsert( extant, live.back(), static_cast<uint32_t>( next ) ) ;
+    }
+
+    std::size_t hits = 0 ;
+    auto t0 = std::chrono::steady_clock::now() ;
+    for ( std::size_t e = 0; e < nevents; ++e, ++next ) {
+
+        // transmission: parent lookup + insertion of the new lineage
+        std::size_t ix = rng() % live.size() ;
+        hits += mapContains( extant, live[ix] ) ;
+        LineageInfo child( next, next % 7 ) ;
+        mapInsert( extant, child, static_cast<uint32_t>( next ) ) ;
+        live.push_back( child ) ;
+
+        // removal of a random extant lineage
+        ix = rng() % live.size() ;
+        if ( ( e % 10 ) == 0 )
+            sampled.insert( live[ix] ) ;
+        extant.erase( live[ix] ) ;
+        live[ix] = live.back() ;
+        live.pop_back() ;
+
+        hits += setContains( sampled, live[ rng() % live.size() ] ) ;
+
+    }
+    auto t1 = std::chrono::steady_clock::now() ;
+
+    if ( hits == 0 ) // keeps the loop alive under optimisation
+        std::printf( "!" ) ;
+
+    return nevents / std::chrono::duration<double>( t1 - t0 ).count() ;
+
+}
+
+int main() {
+
+    const std::size_t nevents = 5000000 ;
+    std::printf( "%10s %22s %22s %8s\n", "live", "std::unordered (ev/s)", "FlatHash (ev/s)", "speedup" ) ;
+
+    for ( std::size_t nlive : { 1000, 100000, 1000000 } ) {
+
+        double tStd  = churn< std::unordered_map<LineageInfo,uint32_t>, std::unordered_set<LineageInfo> >( nlive, nevents, 1 ) ;
+        double tFlat = churn< FlatHashMap<LineageInfo,uint32_t>, FlatHashSet<LineageInfo> >( nlive, nevents, 1 ) ;
+        std::printf( "%10zu %22.3e %22.3e %8.2f\n", nlive, tStd, tFlat, tFlat / tStd ) ;
+
+    }
+
+    return 0 ;
+
+}
@@ -0,0 +1,102 @@
+//
+//  bench_flat_phylogeny.cpp
+//  BDmodel
+//
+//  Conversion of a large reduced tree (Birth & Death epidemic, R0 = 1.5,
+//  all removed lineages sampled) to a phylogenetic tree: 'PhyloNode' trees
+//  against 'FlatPhylogeny' arrays (see 'getAncestralTree'). Times building,
+//  a traversal (total branch length) and freeing; flat arrays are also
+//  timed when reused for a second tree.
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+double seconds( std::chrono::steady_clock::time_point start ) {
+
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 2000000 ;
+    double R0 = 1.5 ;
+
+    m_mt.seed( 1 ) ;
+    LineageTree<int,int> tree ;
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+    tree.addExtantLineageExternal( t, next, 0 ) ;
+    I.push_back( next++ ) ;
+
+    while ( next <= ncases and !I.empty() ) {
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, 0, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+
+    ReducedForest<int,int> rtrees( tree.subSampleTree() ) ;
+    LineageTreeNode<int,int>* rtree = rtrees[0] ;
+
+    // pointer-based tree
+    auto t0 = std::chrono::steady_clock::now() ;
+    PhyloNode<int,int>* atree = getAncestralTree( rtree ) ;
+    double tBuild = seconds( t0 ) ;
+
+    t0 = std::chrono::steady_clock::now() ;
+    double length = 0. ;
+    std::size_t nnodes = 0 ;
+    visitPreOrder( atree, PhyloNodeChildren(), [&]( PhyloNode<int,int>* node ) { length += node->dt ; ++nnodes ; } ) ;
+    double tTraverse = seconds( t0 ) ;
+
+    t0 = std::chrono::steady_clock::now() ;
+    deletePhyloNodeTree( atree ) ;
+    double tFree = seconds( t0 ) ;
+
+    // flat tree (preorder: traversals are plain loops)
+    FlatPhylogeny<int,int>* flat = new FlatPhylogeny<int,int>() ;
+    t0 = std::chrono::steady_clock::now() ;
+    getAncestralTree( rtree, *flat ) ;
+    double tFlatBuild = seconds( t0 ) ;
+
+    t0 = std::chrono::steady_clock::now() ;
+    double flatLength = 0. ;
+    for ( double dt : flat->dt )
+        flatLength += dt ;
+    double tFlatTraverse = seconds( t0 ) ;
+
+    t0 = std::chrono::steady_clock::now() ;
+    getAncestralTree( rtree, *flat ) ; // arrays reused
+    double tFlatRebuild = seconds( t0 ) ;
+
+    t0 = std::chrono::steady_clock::now() ;
+    delete flat ;
+    double tFlatFree = seconds( t0 ) ;
+
+    std::printf( "BD model, R0 = %.1f, %d cases, %zu phylogenetic nodes\n", R0, ncases, nnodes ) ;
+    std::printf( "%-14s %10s %12s %10s %10s %6s\n", "tree", "build (s)", "traverse (s)", "free (s)", "reuse (s)", "same" ) ;
+    std::printf( "%-14s %10.3f %12.4f %10.3f %10s %6s\n", "PhyloNode", tBuild, tTraverse, tFree, "-", "-" ) ;
+    std::printf( "%-14s %10.3f %12.4f %10.3f %10.3f %6s\n", "FlatPhylogeny", tFlatBuild, tFlatTraverse, tFlatFree, tFlatRebuild, ( flatLength == length ) ? "yes" : "NO" ) ;
+
+    return 0 ;
+
+}
@@ -0,0 +1,143 @@
+//
+//  bench_lazy_pruning.cpp
+//  BDmodel
+//
+//  Amortized cost per event of eager pruning against lazy pruning with
+//  bulk sweeps ('LineageTree::setLazyPruning', 'compact') for several
+//  sweep thresholds, on supercritical Birth & Death epidemics. The cost
+//  of lazy modes includes a final sweep. Trees are compared up to the
+//  order of children (the only difference between modes).
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+ Tree string with children sorted, hence independent of their order.
+ */
+std::string canonical( PhyloNode<int,int>* root ) {
+
+    std::vector<std::string> strings ; // of visited nodes, in post-order
+    visitPostOrder( root, PhyloNodeChildren(), [&]( PhyloNode<int,int>* node ) {
+        std::string s ;
+        if ( node->leftChild != nullptr ) { // children strings are on top of the stack
+            std::size_t n = ( node->rightChild != nullptr ) ? 2 : 1 ;
+            std::sort( strings.end() - n, strings.end() ) ;
+            s = "(" ;
+            for ( std::size_t i = strings.size() - n; i < strings.size(); ++i )
+                s += strings[i] + "," ;
+            strings.resize( strings.size() - n ) ;
+            s += ")" ;
+        }
+        else
+            s = std::to_string( node->lng ) ;
+        strings.push_back( s + ":" + std::to_string( node->dt ) ) ;
+    } ) ;
+    return strings.back() ;
+
+}
+
+/*
+ Runs the epidemic with pruning threshold 'maxNodes' (eager if negative);
+ returns the time per event in nanoseconds.
+ */
+double run( double R0, int ncases, long maxNodes, std::size_t& peak, std::string& trees ) {
+
+    const double rho = 0.01 ;
+    m_mt.seed( 1 ) ;
+
+    LineageTree<int,int> tree ;
+    if ( maxNodes >= 0 )
+        tree.setLazyPruning( true, static_cast<std::size_t>( maxNodes ) ) ;
+
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+    long nevents = 0 ;
+    peak = 0 ;
+
+    auto t0 = std::chrono::steady_clock::now() ;
+
+    tree.addExtantLineageExternal( t, next, 0 ) ;
+    I.push_back( next++ ) ;
+
+    while ( next <= ncases and !I.empty() ) {
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, 0, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            if ( getBool( rho ) )
+                tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+        ++nevents ;
+        if ( ( nevents & 1023 ) == 0 )
+            peak = std::max( peak, static_cast<std::size_t>( tree.getSizeNodes() ) ) ;
+
+    }
+
+    if ( tree.isLazyPruning() )
+        tree.compact() ;
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+    std::vector<std::string> strings ;
+    for ( LineageTreeNode<int,int>* rtree : tree.subSampleTree() ) {
+        PhyloNode<int,int>* atree = getAncestralTree( rtree ) ;
+        strings.push_back( canonical( atree ) ) ;
+        deletePhyloNodeTree( atree ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+    std::sort( strings.begin(), strings.end() ) ;
+    trees.clear() ;
+    for ( const std::string& s : strings )
+        trees += s + ";" ;
+
+    return 1e9 * seconds / nevents ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 5000000 ;
+
+    std::size_t peak ;
+    std::string eagerTrees, lazyTrees ;
+    run( 1.5, ncases, -1, peak, eagerTrees ) ; // warm-up (first touch of memory)
+
+    for ( double R0 : { 1.2, 1.5, 2. } ) {
+
+        std::printf( "BD model, R0 = %.1f, %d cases\n", R0, ncases ) ;
+        std::printf( "%-24s %14s %12s %6s\n", "pruning", "ns per event", "peak nodes", "same" ) ;
+
+        double eager = run( R0, ncases, -1, peak, eagerTrees ) ;
+        std::printf( "%-24s %14.1f %12zu %6s\n", "eager", eager, peak, "-" ) ;
+
+        for ( long maxNodes : { 100000L, 1000000L, 0L } ) {
+
+            double lazy = run( R0, ncases, maxNodes, peak, lazyTrees ) ;
+            std::string name = ( maxNodes > 0 ) ? "lazy, sweep at " + std::to_string( maxNodes ) : "lazy, final sweep only" ;
+            std::printf( "%-24s %14.1f %12zu %6s\n", name.c_str(), lazy, peak, ( lazyTrees == eagerTrees ) ? "yes" : "NO" ) ;
+
+        }
+
+    }
+
+    return 0 ;
+
+}
@@ -0,0 +1,153 @@
+//
+//  bench_newick_writer.cpp
+//  BDmodel
+//
+//  Newick and NHX writing of a large phylogenetic tree (Birth & Death
+//  epidemic, R0 = 1.5): the former writer (a copy of it is kept below,
+//  based on 'std::to_string', 'lng2string' and string concatenation)
+//  against 'getSimpleNewick' and 'getNHX', on 'PhyloNode' and
+//  'FlatPhylogeny' trees, with 6 decimals (same output) and with the
+//  shortest representation of numbers.
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+ Former writer (for reference).
+ */
+struct LegacyWriter {
+
+    std::string& out ;
+    bool nhx ;
+    std::vector<bool> open ;
+
+    void writeMetadata( PhyloNode<int,int>* node ) {
+
+        out += "[&&NHX:" + data2string( node ) + ":" + std::to_string( node->t ) ;
+        out += "]";
+
+    }
+
+    bool enter( PhyloNode<int,int>* node ) {
+
+        if ( !open.empty() ) {
+            if ( open.back() )
+                out += "," ;
+            open.back() = true ;
+        }
+
+        if ( node->leftChild == nullptr ) {
+            out += lng2string( node->lng ) + ":" + std::to_string( node->dt ) ;
+            if ( nhx )
+                writeMetadata( node ) ;
+            return false ;
+        }
+
+        out += "(" ;
+        open.push_back( false ) ;
+        return true ;
+
+    }
+
+    void leave( PhyloNode<int,int>* node ) {
+
+        if ( node->leftChild == nullptr )
+            return ;
+
+        open.pop_back() ;
+        out += ")" ;
+        out += lng2string( node->lng ) + "-" + std::to_string( node->depth ) ;
+        out += ":" + std::to_string( node->dt ) ;
+        if ( nhx )
+            writeMetadata( node ) ;
+
+    }
+
+} ;
+
+std::string legacy( PhyloNode<int,int>* root, bool nhx ) {
+
+    std::string res ;
+    LegacyWriter writer{ res, nhx, {} } ;
+    traverseDepthFirst( root, PhyloNodeChildren(), writer ) ;
+    res += ";" ;
+    return res ;
+
+}
+
+template <class F>
+double timed( F f, std::string& res ) {
+
+    auto t0 = std::chrono::steady_clock::now() ;
+    res = f() ;
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 1000000 ;
+    double R0 = 1.5, rho = 0.2 ;
+
+    m_mt.seed( 1 ) ;
+    LineageTree<int,int> tree ;
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+    tree.addExtantLineageExternal( t, next, 0 ) ;
+    I.push_back( next++ ) ;
+
+    while ( next <= ncases and !I.empty() ) {
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, next % 7, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            if ( getBool( rho ) )
+                tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+
+    ReducedForest<int,int> rtrees( tree.subSampleTree() ) ;
+    PhyloTree<int,int> atree( getAncestralTree( rtrees[0] ) ) ;
+    FlatPhylogeny<int,int> flat ;
+    getAncestralTree( rtrees[0], flat ) ;
+
+    std::printf( "BD model, R0 = %.1f, %d cases, %zu phylogenetic nodes\n", R0, ncases, flat.size() ) ;
+    std::printf( "%-30s %10s %10s %8s %6s\n", "writer", "time (s)", "MB", "speedup", "same" ) ;
+
+    for ( bool nhx : { false, true } ) {
+
+        std::string reference, res ;
+        double tLegacy = timed( [&]() { return legacy( atree.get(), nhx ) ; }, reference ) ;
+        std::printf( "%-30s %10.3f %10.1f %8.2f %6s\n", nhx ? "NHX, former" : "Newick, former", tLegacy, reference.size() / 1e6, 1., "-" ) ;
+
+        double tNew = timed( [&]() { return nhx ? getNHX( atree.get() ) : getSimpleNewick( atree.get() ) ; }, res ) ;
+        std::printf( "%-30s %10.3f %10.1f %8.2f %6s\n", nhx ? "NHX, PhyloNode" : "Newick, PhyloNode", tNew, res.size() / 1e6, tLegacy / tNew, ( res == reference ) ? "yes" : "NO" ) ;
+
+        double tFlat = timed( [&]() { return nhx ? getNHX( flat ) : getSimpleNewick( flat ) ; }, res ) ;
+        std::printf( "%-30s %10.3f %10.1f %8.2f %6s\n", nhx ? "NHX, FlatPhylogeny" : "Newick, FlatPhylogeny", tFlat, res.size() / 1e6, tLegacy / tFlat, ( res == reference ) ? "yes" : "NO" ) ;
+
+        double tShortest = timed( [&]() { return nhx ? getNHX( flat, nullptr, NewickFormat::shortest() ) : getSimpleNewick( flat, NewickFormat::shortest() ) ; }, res ) ;
+        std::printf( "%-30s %10.3f %10.1f %8.2f %6s\n", nhx ? "NHX, FlatPhylogeny, shortest" : "Newick, FlatPhylogeny, shortest", tShortest, res.size() / 1e6, tLegacy / tShortest, "-" ) ;
+
+    }
+
+    return 0 ;
+
+}
@@ -0,0 +1,107 @@
+//
+//  bench_node_layout.cpp
+//  BDmodel
+//
+//  Tracking throughput of the two node layouts of LineageTree (AoSLayout,
+//  SoALayout) on a critical Birth & Death epidemic (R0 = 1), where most
+//  of the time is spent pruning extinct lineages. The epidemic is re-seeded
+//  by an introduction whenever it goes extinct, until 'ncases' lineages have
+//  been created. Both layouts replay the exact same event sequence.
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct Timing {
+    double simulate ; // seconds
+    double extract ; // seconds
+    std::size_t nodes ;
+    std::size_t tips ;
+} ;
+
+template <class Tree>
+Timing runBD( int ncases, double R0, double dI, double rho, int seed ) {
+
+    m_mt.seed( seed ) ;
+
+    double mu = 1. / dI ;
+    double beta = R0 * mu ;
+    double t = 0. ;
+    int next = 1 ;
+
+    Tree tree ;
+    std::vector<int> I ;
+    I.reserve( 10000 ) ;
+
+    auto t0 = std::chrono::steady_clock::now() ;
+    while ( next <= ncases ) {
+
+        if ( I.empty() ) { // (re-)introduction
+            tree.addExtantLineageExternal( t, next, 0 ) ;
+            I.push_back( next++ ) ;
+        }
+
+        double rate = ( beta + mu ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * rate <= beta * I.size() ) { // transmission
+            tree.addExtantLineage( t, next, 0, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            if ( getBool( rho ) )
+                tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+    auto t1 = std::chrono::steady_clock::now() ;
+
+    std::vector<LineageTreeNode<int,int>*> rtrees = tree.subSampleTree() ;
+    auto t2 = std::chrono::steady_clock::now() ;
+
+    std::size_t tips = 0 ;
+    for ( LineageTreeNode<int,int>* rtree : rtrees ) {
+        visitPreOrder( rtree, LineageTreeNodeChildren(), [&]( LineageTreeNode<int,int>* node ) { tips += node->sampled ; } ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+
+    Timing res ;
+    res.simulate = std::chrono::duration<double>( t1 - t0 ).count() ;
+    res.extract = std::chrono::duration<double>( t2 - t1 ).count() ;
+    res.nodes = tree.getSizeNodes() ;
+    res.tips = tips ;
+    return res ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 10000000 ;
+    double R0 = ( argc > 2 ) ? std::atof( argv[2] ) : 1. ;
+    double dI = 1., rho = 0.01 ;
+
+    std::printf( "BD model, R0 = %.2f, rho = %.2f, %d cases\n", R0, rho, ncases ) ;
+    std::printf( "node size (bytes): hot %zu, cold %zu\n", sizeof( LineageTrackingHot ), sizeof( LineageTrackingCold<int,int> ) ) ;
+    std::printf( "%6s %14s %14s %12s %10s\n", "layout", "simulate (s)", "extract (s)", "nodes", "tips" ) ;
+
+    for ( int seed = 1; seed <= 3; ++seed ) {
+
+        Timing aos = runBD< LineageTree<int,int,std::hash<int>,DenseLineageIndex<int>,AoSLayout> >( ncases, R0, dI, rho, seed ) ;
+        Timing soa = runBD< LineageTree<int,int,std::hash<int>,DenseLineageIndex<int>,SoALayout> >( ncases, R0, dI, rho, seed ) ;
+
+        std::printf( "%6s %14.3f %14.3f %12zu %10zu\n", "AoS", aos.simulate, aos.extract, aos.nodes, aos.tips ) ;
+        std::printf( "%6s %14.3f %14.3f %12zu %10zu\n", "SoA", soa.simulate, soa.extract, soa.nodes, soa.tips ) ;
+
+    }
+
+    return 0 ;
+
+}
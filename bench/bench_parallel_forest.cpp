@@ -0,0 +1,88 @@
+//
+//  bench_parallel_forest.cpp
+//  BDmodel
+//
+//  Forest extraction (reduction, conversion to phylogenetic trees and NHX
+//  writing) of the serial pipeline against 'extractForest' on 1 to 32
+//  threads. The forest mixes one dominant, slightly supercritical chain
+//  (R0 = 1.05) with frequent introductions, as in a large outbreak seeded
+//  by many travellers.
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 5000000 ;
+    double pIntro = ( argc > 2 ) ? std::atof( argv[2] ) : 0.001 ; // per event
+    double R0 = 1.05, rho = 0.1 ;
+
+    m_mt.seed( 1 ) ;
+
+    LineageTree<int,int> tree ;
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+
+    while ( next <= ncases ) {
+
+        if ( I.empty() or getBool( pIntro ) ) { // introduction
+            tree.addExtantLineageExternal( t, next, 0 ) ;
+            I.push_back( next++ ) ;
+        }
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, 0, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            if ( getBool( rho ) )
+                tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+
+    // serial pipeline
+    auto t0 = std::chrono::steady_clock::now() ;
+    std::vector<std::string> serial ;
+    std::size_t largest = 0 ;
+    for ( LineageTreeNode<int,int>* rtree : tree.subSampleTree() ) {
+        PhyloNode<int,int>* atree = getAncestralTree( rtree ) ;
+        serial.push_back( getNHX( atree ) ) ;
+        largest = std::max( largest, serial.back().size() ) ;
+        deletePhyloNodeTree( atree ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+    double tSerial = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+    std::printf( "%d cases, %zu trees (largest: %zu characters), %u hardware threads\n", ncases, serial.size(), largest, std::thread::hardware_concurrency() ) ;
+    std::printf( "%8s %12s %8s %6s\n", "threads", "time (s)", "speedup", "same" ) ;
+    std::printf( "%8s %12.3f %8.2f %6s\n", "serial", tSerial, 1., "-" ) ;
+
+    for ( unsigned nthreads : { 1, 2, 4, 8, 16, 32 } ) {
+
+        auto t1 = std::chrono::steady_clock::now() ;
+        std::vector<std::string> parallel = extractForest( tree, nthreads, true ) ;
+        double tParallel = std::chrono::duration<double>( std::chrono::steady_clock::now() - t1 ).count() ;
+
+        std::printf( "%8u %12.3f %8.2f %6s\n", nthreads, tParallel, tSerial / tParallel, ( parallel == serial ) ? "yes" : "NO" ) ;
+
+    }
+
+    return 0 ;
+
+}
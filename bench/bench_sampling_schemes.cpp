@@ -0,0 +1,120 @@
+//
+//  bench_sampling_schemes.cpp
+//  BDmodel
+//
+//  Trees for several sampling probabilities of the same Birth & Death
+//  epidemic (R0 = 1.5): one run per sampling probability against a single
+//  run tracking all of them as sampling schemes ('addSamplingScheme',
+//  'subSampleTree( schemes )'). Both draw the same epidemic and samples,
+//  hence trees are compared.
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+ Newick strings of the trees of 'rtrees' (freed), sorted.
+ */
+std::vector<std::string> forest( const std::vector<LineageTreeNode<int,int>*>& rtrees ) {
+
+    std::vector<std::string> strings ;
+    for ( LineageTreeNode<int,int>* rtree : rtrees ) {
+        PhyloNode<int,int>* atree = getAncestralTree( rtree ) ;
+        strings.push_back( getSimpleNewick( atree ) ) ;
+        deletePhyloNodeTree( atree ) ;
+        deleteLineageTreeNodeTree( rtree ) ;
+    }
+    std::sort( strings.begin(), strings.end() ) ;
+    return strings ;
+
+}
+
+/*
+ Runs the epidemic, sampling removed lineages with probabilities 'rhos'.
+ Tracks all schemes in one tree if 'scheme' is negative, else only scheme
+ 'scheme'. Draws do not depend on 'scheme', hence all runs see the same
+ epidemic and samples. Returns the trees of each tracked scheme.
+ */
+std::vector<std::vector<std::string>> run( int ncases, const std::vector<double>& rhos, int scheme ) {
+
+    const double R0 = 1.5 ;
+    m_mt.seed( 1 ) ;
+
+    LineageTree<int,int> tree ;
+    std::vector<SchemeSet> schemes ;
+    for ( std::size_t k = 0; k < rhos.size(); ++k )
+        schemes.push_back( tree.addSamplingScheme( "rho=" + std::to_string( rhos[k] ) ) ) ;
+
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+    tree.addExtantLineageExternal( t, next, 0 ) ;
+    I.push_back( next++ ) ;
+
+    while ( next <= ncases and !I.empty() ) {
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, 0, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal, sampled by each scheme independently
+            SchemeSet sampled ;
+            for ( std::size_t k = 0; k < rhos.size(); ++k ) {
+                if ( getBool( rhos[k] ) and ( scheme < 0 or static_cast<std::size_t>( scheme ) == k ) )
+                    sampled |= schemes[k] ;
+            }
+            if ( !sampled.empty() )
+                tree.sampleExtantLineage( I[ix], t, sampled ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+
+    std::vector<std::vector<std::string>> trees ;
+    for ( std::size_t k = 0; k < rhos.size(); ++k ) {
+        if ( scheme < 0 or static_cast<std::size_t>( scheme ) == k )
+            trees.push_back( forest( tree.subSampleTree( schemes[k] ) ) ) ;
+    }
+    return trees ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 1000000 ;
+    int nschemes = ( argc > 2 ) ? std::atoi( argv[2] ) : 16 ;
+
+    std::vector<double> rhos ;
+    for ( int k = 0; k < nschemes; ++k )
+        rhos.push_back( 0.001 * ( k + 1 ) ) ; // 0.1% to 1.6% (16 schemes)
+
+    auto t0 = std::chrono::steady_clock::now() ;
+    std::vector<std::vector<std::string>> separate ;
+    for ( int k = 0; k < nschemes; ++k )
+        separate.push_back( run( ncases, rhos, k )[0] ) ;
+    double tSeparate = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+    auto t1 = std::chrono::steady_clock::now() ;
+    std::vector<std::vector<std::string>> joint = run( ncases, rhos, -1 ) ;
+    double tJoint = std::chrono::duration<double>( std::chrono::steady_clock::now() - t1 ).count() ;
+
+    std::printf( "BD model, R0 = 1.5, %d cases, %d sampling schemes\n", ncases, nschemes ) ;
+    std::printf( "%-20s %10s %8s %6s\n", "runs", "time (s)", "speedup", "same" ) ;
+    std::printf( "%-20s %10.3f %8.2f %6s\n", "one per scheme", tSeparate, 1., "-" ) ;
+    std::printf( "%-20s %10.3f %8.2f %6s\n", "one for all", tJoint, tSeparate / tJoint, ( joint == separate ) ? "yes" : "NO" ) ;
+
+    return 0 ;
+
+}
@@ -0,0 +1,123 @@
+//
+//  bench_streaming_writer.cpp
+//  BDmodel
+//
+//  Writing a large phylogenetic tree (Birth & Death epidemic, R0 = 1.5)
+//  to a file: 'getSimpleNewick' / 'getNHX' then writing the string (the
+//  whole text in memory), against 'writeSimpleNewick' / 'writeNHX' to a
+//  'FileSink' (a buffer of 'STREAM_CHUNK_SIZE' bytes), and to a
+//  'GzipSink' if compiled with -DTREE_ZLIB (and -lz). Checks that files
+//  are the same.
+//
+//  Usage: bench_streaming_writer [ncases] [path]
+//
+
+#include "tree.hpp"
+#include "random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static std::string readFile( const std::string& path ) {
+
+    std::ifstream in( path, std::ios::binary ) ;
+    return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() ) ;
+
+}
+
+static double seconds( std::chrono::steady_clock::time_point t0 ) {
+
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+
+}
+
+int main( int argc, char** argv ) {
+
+    int ncases = ( argc > 1 ) ? std::atoi( argv[1] ) : 2000000 ;
+    std::string path = ( argc > 2 ) ? argv[2] : "bench_streaming_writer.nwk" ;
+    double R0 = 1.5, rho = 0.2 ;
+
+    m_mt.seed( 1 ) ;
+    LineageTree<int,int> tree ;
+    std::vector<int> I ;
+    double t = 0. ;
+    int next = 1 ;
+    tree.addExtantLineageExternal( t, next, 0 ) ;
+    I.push_back( next++ ) ;
+
+    while ( next <= ncases and !I.empty() ) {
+
+        double rate = ( R0 + 1. ) * I.size() ;
+        t += getExpo( rate ) ;
+        int ix = getUniInt( static_cast<int>( I.size() ) - 1 ) ;
+
+        if ( getUni() * ( R0 + 1. ) < R0 ) { // transmission
+            tree.addExtantLineage( t, next, next % 7, I[ix] ) ;
+            I.push_back( next++ ) ;
+        }
+        else { // removal
+            if ( getBool( rho ) )
+                tree.sampleExtantLineage( I[ix], t ) ;
+            tree.removeExtantLineage( I[ix] ) ;
+            I[ix] = I.back() ;
+            I.pop_back() ;
+        }
+
+    }
+
+    ReducedForest<int,int> rtrees( tree.subSampleTree() ) ;
+    FlatPhylogeny<int,int> flat ;
+    getAncestralTree( rtrees[0], flat ) ;
+
+    std::printf( "BD model, R0 = %.1f, %d cases, %zu phylogenetic nodes\n", R0, ncases, flat.size() ) ;
+    std::printf( "%-24s %10s %14s %10s %6s\n", "writer", "time (s)", "text in memory", "file (MB)", "same" ) ;
+
+    for ( bool nhx : { false, true } ) {
+
+        auto t0 = std::chrono::steady_clock::now() ;
+        std::size_t held = 0 ;
+        {
+            std::string text = nhx ? getNHX( flat ) : getSimpleNewick( flat ) ;
+            held = text.capacity() ;
+            std::ofstream out( path, std::ios::binary | std::ios::trunc ) ;
+            out.write( text.data(), text.size() ) ;
+        }
+        double tString = seconds( t0 ) ;
+        std::string reference = readFile( path ) ;
+        std::printf( "%-24s %10.3f %11.1f MB %10.1f %6s\n", nhx ? "NHX, string" : "Newick, string", tString, held / 1e6, reference.size() / 1e6, "-" ) ;
+
+        t0 = std::chrono::steady_clock::now() ;
+        {
+            FileSink file ;
+            bool ok = file.open( path ) and ( nhx ? writeNHX( file, flat ) : writeSimpleNewick( file, flat ) ) and file.close() ;
+            if ( !ok )
+                std::printf( "cannot write %s\n", path.c_str() ) ;
+        }
+        double tStream = seconds( t0 ) ;
+        std::printf( "%-24s %10.3f %11.1f MB %10.1f %6s\n", nhx ? "NHX, FileSink" : "Newick, FileSink", tStream, ( STREAM_CHUNK_SIZE + ( 1 << 16 ) ) / 1e6, reference.size() / 1e6, ( readFile( path ) == reference ) ? "yes" : "NO" ) ;
+
+#ifdef TREE_ZLIB
+        t0 = std::chrono::steady_clock::now() ;
+        {
+            FileSink file ;
+            file.open( path + ".gz" ) ;
+            GzipSink gz( file, 1 ) ;
+            bool ok = ( nhx ? writeNHX( gz, flat ) : writeSimpleNewick( gz, flat ) ) and gz.close() and file.close() ;
+            if ( !ok )
+                std::printf( "cannot write %s.gz\n", path.c_str() ) ;
+        }
+        double tGzip = seconds( t0 ) ;
+        std::printf( "%-24s %10.3f %11.1f MB %10.1f %6s\n", nhx ? "NHX, GzipSink (1)" : "Newick, GzipSink (1)", tGzip, ( STREAM_CHUNK_SIZE + 2 * ( 1 << 16 ) ) / 1e6, readFile( path + ".gz" ).size() / 1e6, "-" ) ;
+        std::remove( ( path + ".gz" ).c_str() ) ;
+#endif
+
+    }
+
+    std::remove( path.c_str() ) ;
+    return 0 ;
+
+}
@@ -0,0 +1,269 @@
+//
+//  binary_io.hpp
+//  BDmodel
+//
+
+#ifndef binary_io_hpp
+#define binary_io_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BINARY_IO_MMAP
+#endif
+
+
+//====== BinaryWriter ======//
+
+/*
+
+ Writes values to a stream in their in-memory (native) representation,
+ e.g. to checkpoint a simulation. Values go straight to the stream, hence
+ large states are written without building a copy in memory first.
+
+ N.B. files are meant to be read back by the same program on the same
+ kind of machine (no conversion of endianness or type sizes).
+
+ */
+
+class BinaryWriter {
+public:
+
+    explicit BinaryWriter( std::ostream& out ): out( out ) {} ;
+
+    template <typename V>
+    void write( const V& value ) {
+
+        static_assert( std::is_trivially_copyable<V>::value, "use saveValue for types that are not trivially copyable" ) ;
+        out.write( reinterpret_cast<const char*>( &value ), sizeof( V ) ) ;
+
+    }
+
+    template <typename V>
+    void writeArray( const V* values, std::size_t n ) {
+
+        static_assert( std::is_trivially_copyable<V>::value, "use saveValue for types that are not trivially copyable" ) ;
+        out.write( reinterpret_cast<const char*>( values ), n * sizeof( V ) ) ;
+
+    }
+
+    template <typename V>
+    void writeVector( const std::vector<V>& values ) {
+
+        write<uint64_t>( values.size() ) ;
+        writeArray( values.data(), values.size() ) ;
+
+    }
+
+    void writeString( const std::string& s ) {
+
+        write<uint64_t>( s.size() ) ;
+        out.write( s.data(), s.size() ) ;
+
+    }
+
+    bool good() const { return out.good() ; }
+
+private:
+    std::ostream& out ;
+
+} ;
+
+
+//====== BinaryReader ======//
+
+/*
+
+ Reads values written by 'BinaryWriter' from a block of memory (typically
+ a 'MappedFile'). Reading past the end of the block sets 'failed' (and
+ yields default values) instead of reading out of bounds, hence truncated
+ or corrupted files are detected with a single check at the end.
+
+ */
+
+class BinaryReader {
+public:
+
+    BinaryReader( const char* data, std::size_t size ): data( data ), size( size ), pos( 0 ), failed( false ) {} ;
+
+    template <typename V>
+    V read() {
+
+        static_assert( std::is_trivially_copyable<V>::value, "use loadValue for types that are not trivially copyable" ) ;
+        V value = V() ;
+        if ( reserve( sizeof( V ) ) ) {
+            std::memcpy( &value, data + pos, sizeof( V ) ) ;
+            pos += sizeof( V ) ;
+        }
+        return value ;
+
+    }
+
+    template <typename V>
+    void readVector( std::vector<V>& values ) {
+
+        static_assert( std::is_trivially_copyable<V>::value, "use loadValue for types that are not trivially copyable" ) ;
+        uint64_t n = read<uint64_t>() ;
+        values.clear() ;
+        if ( n <= ( size - pos ) / sizeof( V ) and reserve( n * sizeof( V ) ) ) {
+            values.resize( n ) ;
+            if ( n > 0 ) // 'data()' may be null
+                std::memcpy( values.data(), data + pos, n * sizeof( V ) ) ;
+            pos += n * sizeof( V ) ;
+        }
+        else
+            failed = true ;
+
+    }
+
+    std::string readString() {
+
+        uint64_t n = read<uint64_t>() ;
+        if ( n > size - pos or !reserve( n ) ) {
+            failed = true ;
+            return std::string() ;
+        }
+        std::string s( data + pos, n ) ;
+        pos += n ;
+        return s ;
+
+    }
+
+    bool ok() const { return !failed ; }
+    void fail() { failed = true ; } // e.g. when a value read is invalid
+    std::size_t position() const { return pos ; } // number of bytes read so far
+
+private:
+    const char* data ;
+    std::size_t size ;
+    std::size_t pos ;
+    bool failed ;
+
+    bool reserve( std::size_t n ) {
+
+        if ( failed or n > size - pos )
+            failed = true ;
+        return !failed ;
+
+    }
+
+} ;
+
+/*
+
+ Values of user types (lineage identifiers, metadata) are written and read
+ through 'saveValue' and 'loadValue'. Trivially copyable types work as they
+ are; overload both functions for other types (see the 'std::string' case).
+
+ */
+
+template <typename V>
+void saveValue( BinaryWriter& out, const V& value ) { out.write( value ) ; }
+
+template <typename V>
+void loadValue( BinaryReader& in, V& value ) { value = in.template read<V>() ; }
+
+inline void saveValue( BinaryWriter& out, const std::string& value ) { out.writeString( value ) ; }
+
+inline void loadValue( BinaryReader& in, std::string& value ) { value = in.readString() ; }
+
+
+//====== MappedFile ======//
+
+/*
+
+ Read-only view of a whole file. The file is memory-mapped where possible
+ (POSIX), so that only the pages actually read are loaded; elsewhere it is
+ read into memory.
+
+ */
+
+class MappedFile {
+public:
+
+    MappedFile(): bytes( nullptr ), nbytes( 0 ), mapped( false ) {} ;
+    ~MappedFile() { close() ; }
+
+    MappedFile( const MappedFile& ) = delete ;
+    MappedFile& operator=( const MappedFile& ) = delete ;
+
+    /*
+     Returns 'false' if 'path' cannot be read.
+     */
+    bool open( const std::string& path ) {
+
+        close() ;
+
+#ifdef BINARY_IO_MMAP
+        int fd = ::open( path.c_str(), O_RDONLY ) ;
+        if ( fd < 0 )
+            return false ;
+
+        struct stat st ;
+        if ( fstat( fd, &st ) != 0 ) {
+            ::close( fd ) ;
+            return false ;
+        }
+
+        nbytes = static_cast<std::size_t>( st.st_size ) ;
+        if ( nbytes > 0 ) {
+            void* addr = mmap( nullptr, nbytes, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+            ::close( fd ) ; // the mapping stays valid
+            if ( addr == MAP_FAILED ) {
+                nbytes = 0 ;
+                return false ;
+            }
+            bytes = static_cast<const char*>( addr ) ;
+            mapped = true ;
+        }
+        else
+            ::close( fd ) ;
+        return true ;
+#else
+        std::ifstream in( path, std::ios::binary ) ;
+        if ( !in )
+            return false ;
+        buffer.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() ) ;
+        bytes = buffer.data() ;
+        nbytes = buffer.size() ;
+        return true ;
+#endif
+
+    }
+
+    void close() {
+
+#ifdef BINARY_IO_MMAP
+        if ( mapped )
+            munmap( const_cast<char*>( bytes ), nbytes ) ;
+#endif
+        buffer.clear() ;
+        bytes = nullptr ;
+        nbytes = 0 ;
+        mapped = false ;
+
+    }
+
+    const char* data() const { return bytes ; }
+    std::size_t size() const { return nbytes ; }
+
+private:
+    const char* bytes ;
+    std::size_t nbytes ;
+    bool mapped ;
+    std::vector<char> buffer ; // file contents if not mapped
+
+} ;
+
+#endif /* binary_io_hpp */
@@ -7,11 +7,28 @@
 
 #include "pysimBD.hpp"
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 
 namespace py = pybind11;
 
+/*
+ Read-only NumPy array viewing 'values' (no copy), which keeps 'owner' (the
+ python object holding 'values') alive as long as the array is referenced.
+ Arrays are read-only since C++ follows the indices they hold (e.g. 'newick').
+ */
+template <typename V>
+static py::array view_array( const std::vector<V>& values, py::handle owner, py::dtype dtype = py::dtype::of<V>() ) {
+    
+    std::vector<py::ssize_t> shape( 1, static_cast<py::ssize_t>( values.size() ) ) ;
+    std::vector<py::ssize_t> strides( 1, static_cast<py::ssize_t>( sizeof( V ) ) ) ;
+    py::array res( dtype, shape, strides, values.data(), owner ) ;
+    res.attr( "setflags" )( py::arg( "write" ) = false ) ; // NumPy's public API
+    return res ;
+    
+}
+
 PYBIND11_MODULE(pysimBD, m) {
     m.doc() = "python binding for c++ code simulating SEIR dynamics in a market"; // optional module docstring
     
@@ -25,4 +42,68 @@ PYBIND11_MODULE(pysimBD, m) {
           py::arg("dI"),
           py::arg("rho") ) ;
     
+    m.def("simulate_BD_tree_to_file", &simulate_BD_to_file, "Same as simulate_BD_tree, writes the tree to a file (gzip if its name ends with .gz) instead of returning it. Returns False if the simulation or writing failed. Raises RuntimeError for .gz paths if the module was built without TREE_ZLIB (the file is then left untouched)",
+          py::arg("seed"),
+          py::arg("max_cases"),
+          py::arg("max_samples"),
+          py::arg("R0"),
+          py::arg("dI"),
+          py::arg("rho"),
+          py::arg("path") ) ;
+    
+    //==== Phylogenetic trees as NumPy arrays (no newick round trip)
+    
+    m.attr("PHYLO_NONE") = PHYLO_NONE ; // missing parent or child
+    
+    py::class_<BDPhylogeny>(m, "BDPhylogeny")
+        .def("__len__", [](const BDPhylogeny& p) { return p.tree.size() ; })
+        .def_property_readonly("parent", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.parent, self ) ; })
+        .def_property_readonly("left_child", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.leftChild, self ) ; })
+        .def_property_readonly("right_child", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.rightChild, self ) ; })
+        .def_property_readonly("t", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.t, self ) ; })
+        .def_property_readonly("dt", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.dt, self ) ; })
+        .def_property_readonly("labels", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().labels, self ) ; })
+        .def_property_readonly("sampled_ancestor", [](py::object self) { return view_array( self.cast<const BDPhylogeny&>().tree.sampledAncestor, self, py::dtype::of<bool>() ) ; })
+        .def("newick", [](const BDPhylogeny& p) { return getSimpleNewick( p.tree ) ; }) ;
+    
+    m.def("simulate_BD_phylogeny", &simulate_BD_phylogeny, "Same as simulate_BD_tree, returns the tree as NumPy arrays (nodes in preorder, root first) instead of a newick string",
+          py::arg("seed"),
+          py::arg("max_cases"),
+          py::arg("max_samples"),
+          py::arg("R0"),
+          py::arg("dI"),
+          py::arg("rho") ) ;
+    
+    //==== Tracker instrumentation (counters require compiling with -DTREE_STATS)
+    
+    py::class_<TrackerSeries>(m, "TrackerSeries")
+        .def_readonly("t", &TrackerSeries::t)
+        .def_readonly("infected", &TrackerSeries::infected)
+        .def_readonly("nodes", &TrackerSeries::nodes)
+        .def_readonly("nodes_allocated", &TrackerSeries::nodes_allocated)
+        .def_readonly("nodes_freed", &TrackerSeries::nodes_freed)
+        .def_readonly("merges", &TrackerSeries::merges) ;
+    
+    py::class_<BDStats>(m, "BDStats")
+        .def_readonly("tree", &BDStats::tree)
+        .def_readonly("stats_enabled", &BDStats::stats_enabled)
+        .def_readonly("nodes_allocated", &BDStats::nodes_allocated)
+        .def_readonly("nodes_freed", &BDStats::nodes_freed)
+        .def_readonly("merges", &BDStats::merges)
+        .def_readonly("peak_nodes", &BDStats::peak_nodes)
+        .def_readonly("bytes_per_node", &BDStats::bytes_per_node)
+        .def_readonly("cascade_depths", &BDStats::cascade_depths)
+        .def_readonly("subsample_seconds", &BDStats::subsample_seconds)
+        .def_readonly("ancestral_seconds", &BDStats::ancestral_seconds)
+        .def_readonly("series", &BDStats::series) ;
+    
+    m.def("simulate_BD_stats", &simulate_BD_stats, "Same as simulate_BD_tree, also returns tracker statistics and their time series",
+          py::arg("seed"),
+          py::arg("max_cases"),
+          py::arg("max_samples"),
+          py::arg("R0"),
+          py::arg("dI"),
+          py::arg("rho"),
+          py::arg("stats_interval") = 0. ) ;
+    
 }
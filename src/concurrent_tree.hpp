@@ -0,0 +1,370 @@
+//
+//  concurrent_tree.hpp
+//  BDmodel
+//
+
+#ifndef concurrent_tree_hpp
+#define concurrent_tree_hpp
+
+#include "tree.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//====== ConcurrentLineageTree ======//
+
+/*
+
+ Thread-safe counterpart of 'LineageTree', for simulators that report
+ events from several threads (e.g. one thread per region).
+
+ Transmission chains never share nodes, hence the forest is split into
+ SHARDS by chain: a chain is assigned to a shard when its root is
+ introduced, and every descendant of the root is stored in the same
+ shard, whichever thread reports it (transmissions across regions need
+ no special care). Each shard is a plain 'LineageTree' behind its own
+ mutex, so threads working on different chains do not contend.
+
+ The shard of every extant lineage is recorded in a map split into
+ STRIPES, each with its own mutex. An event locks one stripe, then one
+ shard, never both at once.
+
+ 'subSampleTree' and 'takeSnapshot' lock all shards and hence see a
+ quiescent state of the whole forest. During a simulation prefer
+ 'takeSnapshot': shards are only locked while snapshots are taken, and
+ trees are built from them while the simulation goes on.
+
+ N.B. events concerning the same lineage must be ordered by the caller
+ as usual (e.g. a lineage is added before it transmits, sampled before
+ it is removed). Roots are spread across shards in hash order, hence the
+ order of the trees returned depends on the number of shards.
+
+ Shards default to 'HashLineageIndex': a dense index would take memory
+ proportional to the largest identifier in every shard.
+
+ */
+
+template <typename T, typename U, class Hash = std::hash<T>, class Index = HashLineageIndex<T,Hash>, class Layout = AoSLayout>
+class ConcurrentLineageTree {
+public:
+
+    typedef LineageTree<T,U,Hash,Index,Layout> Tree ;
+    typedef LineageTreeSnapshot<T,U,Hash> Snapshot ;
+
+    /*
+
+     Constructor (creates an empty tree). 'nshards' bounds the number of
+     threads that can update the tree at once, 'nstripes' the number of
+     threads that can look up lineages at once.
+
+     */
+    ConcurrentLineageTree( std::size_t nshards = 64, std::size_t nstripes = 256 ) {
+
+        assert( nshards > 0 and nstripes > 0 ) ;
+
+        for ( std::size_t i = 0; i < nshards; ++i )
+            shards.push_back( std::unique_ptr<Shard>( new Shard ) ) ;
+
+        for ( std::size_t i = 0; i < nstripes; ++i )
+            stripes.push_back( std::unique_ptr<Stripe>( new Stripe ) ) ;
+
+    } ;
+
+    /*
+
+     Reset function (see 'LineageTree::reset'). Must not run concurrently
+     with other calls.
+
+     */
+    void reset() {
+
+        for ( auto& shard : shards )
+            shard->tree.reset() ;
+
+        for ( auto& stripe : stripes )
+            stripe->shardOf.clear() ;
+
+    } ;
+
+    /*
+
+     Adds a lineage 'lng' born at time 't' with metadata 'data' and no parent
+     (see 'LineageTree::addExtantLineageExternal').
+
+     The new chain goes to shard 'shard' if given (e.g. the index of the
+     calling thread, to keep chains of different threads apart), else to a
+     shard chosen by hashing 'lng'.
+
+     */
+    void addExtantLineageExternal( const double& t, const T& lng, const U& data ) {
+
+        addExtantLineageExternal( t, lng, data, Hash()( lng ) % shards.size() ) ;
+
+    }
+
+    void addExtantLineageExternal( const double& t, const T& lng, const U& data, std::size_t shard ) {
+
+        assert( shard < shards.size() ) ;
+        setShard( lng, static_cast<uint32_t>( shard ) ) ;
+
+        std::lock_guard<std::mutex> lock( shards[shard]->mtx ) ;
+        shards[shard]->tree.addExtantLineageExternal( t, lng, data ) ;
+
+    }
+
+    /*
+
+     Adds a lineage 'lng' born at time 't' with parent 'lngParent' with
+     metadata 'data', in the shard of its parent (see 'LineageTree::addExtantLineage').
+
+     */
+    void addExtantLineage( const double& t, const T& lng, const U& data, const T& lngParent ) {
+
+        uint32_t shard = findShard( lngParent ) ;
+        setShard( lng, shard ) ;
+
+        std::lock_guard<std::mutex> lock( shards[shard]->mtx ) ;
+        shards[shard]->tree.addExtantLineage( t, lng, data, lngParent ) ;
+
+    }
+
+    /*
+
+     Removes lineage 'lng' that became extinct (see 'LineageTree::removeExtantLineage').
+
+     */
+    void removeExtantLineage( const T& lng ) {
+
+        uint32_t shard = NO_SHARD ;
+        {
+            Stripe& stripe = stripeOf( lng ) ;
+            std::lock_guard<std::mutex> lock( stripe.mtx ) ;
+            stripe.shardOf.take( lng, shard ) ;
+        }
+        assert( shard != NO_SHARD ) ; // must be extant
+
+        std::lock_guard<std::mutex> lock( shards[shard]->mtx ) ;
+        shards[shard]->tree.removeExtantLineage( lng ) ;
+
+    }
+
+    /*
+
+     Marks lineage 'lng' as SAMPLED (see 'LineageTree::sampleExtantLineage').
+
+     */
+    bool sampleExtantLineage( const T& lng, const double& t, const std::string& locSample ) {
+
+        return sampleExtantLineage( lng, t, addLocation( locSample ) ) ;
+
+    }
+
+    bool sampleExtantLineage( const T& lng, const double& t, LocationID locSample = LOCATION_DEFAULT ) {
+
+        uint32_t shard = findShard( lng ) ;
+
+        std::lock_guard<std::mutex> lock( shards[shard]->mtx ) ;
+        return shards[shard]->tree.sampleExtantLineage( lng, t, locSample ) ;
+
+    }
+
+    bool sampleExtantLineage( const T& lng, const double& t, SchemeSet schemes, LocationID locSample = LOCATION_DEFAULT ) {
+
+        uint32_t shard = findShard( lng ) ;
+
+        std::lock_guard<std::mutex> lock( shards[shard]->mtx ) ;
+        return shards[shard]->tree.sampleExtantLineage( lng, t, schemes, locSample ) ;
+
+    }
+
+    /*
+
+     Returns the reduced transmission trees of all shards (see 'LineageTree::subSampleTree').
+
+     */
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree() {
+
+        std::vector<std::unique_lock<std::mutex>> locks = lockShards() ;
+
+        std::vector<LineageTreeNode<T,U,Hash>*> res ;
+        for ( auto& shard : shards ) {
+            std::vector<LineageTreeNode<T,U,Hash>*> trees = shard->tree.subSampleTree() ;
+            res.insert( res.end(), trees.begin(), trees.end() ) ;
+        }
+        return res ;
+
+    }
+
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree( SchemeSet schemes ) {
+
+        std::vector<std::unique_lock<std::mutex>> locks = lockShards() ;
+
+        std::vector<LineageTreeNode<T,U,Hash>*> res ;
+        for ( auto& shard : shards ) {
+            std::vector<LineageTreeNode<T,U,Hash>*> trees = shard->tree.subSampleTree( schemes ) ;
+            res.insert( res.end(), trees.begin(), trees.end() ) ;
+        }
+        return res ;
+
+    }
+
+    /*
+
+     Takes snapshots of all shards at once (see 'LineageTree::takeSnapshot').
+     Reduced trees are obtained by calling 'subSampleTree' on every snapshot.
+
+     */
+    std::vector<Snapshot> takeSnapshot( const double& t = 0. ) {
+
+        std::vector<std::unique_lock<std::mutex>> locks = lockShards() ;
+
+        std::vector<Snapshot> res ;
+        res.reserve( shards.size() ) ;
+        for ( auto& shard : shards )
+            res.push_back( shard->tree.takeSnapshot( t ) ) ;
+        return res ;
+
+    }
+
+    /*
+
+     Returns the ID of sampling location 'name' (see 'LineageTree::addLocation').
+     New locations are added to every shard, hence IDs agree across shards.
+
+     */
+    LocationID addLocation( const std::string& name ) {
+
+        std::lock_guard<std::mutex> lock( locationsMtx ) ;
+
+        std::size_t nlocations = locations.size() ;
+        LocationID id = locations.intern( name ) ;
+        if ( locations.size() > nlocations ) { // new location
+            for ( auto& shard : shards ) {
+                std::lock_guard<std::mutex> shardLock( shard->mtx ) ;
+                LocationID shardId = shard->tree.addLocation( name ) ;
+                assert( shardId == id ) ;
+                (void) shardId ;
+            }
+        }
+        return id ;
+
+    }
+
+    /*
+
+     Returns sampling scheme 'name' (see 'LineageTree::addSamplingScheme').
+     New schemes are added to every shard, hence IDs agree across shards.
+
+     */
+    SchemeSet addSamplingScheme( const std::string& name ) {
+
+        std::lock_guard<std::mutex> lock( locationsMtx ) ;
+
+        std::vector<std::unique_lock<std::mutex>> locks = lockShards() ;
+        SchemeSet scheme ;
+        for ( auto& shard : shards )
+            scheme = shard->tree.addSamplingScheme( name ) ;
+        return scheme ;
+
+    }
+
+    /*
+
+     Returns a copy of the sampling locations.
+
+     */
+    LocationDictionary getLocations() {
+
+        std::lock_guard<std::mutex> lock( locationsMtx ) ;
+        return locations ;
+
+    }
+
+    /*
+
+     Returns the number of extant lineages (resp. nodes) summed over shards.
+
+     */
+    std::size_t getSizeExtantLineages() {
+
+        std::size_t n = 0 ;
+        for ( auto& shard : shards ) {
+            std::lock_guard<std::mutex> lock( shard->mtx ) ;
+            n += shard->tree.getSizeExtantLineages() ;
+        }
+        return n ;
+
+    }
+
+    std::size_t getSizeNodes() {
+
+        std::size_t n = 0 ;
+        for ( auto& shard : shards ) {
+            std::lock_guard<std::mutex> lock( shard->mtx ) ;
+            n += shard->tree.getSizeNodes() ;
+        }
+        return n ;
+
+    }
+
+    std::size_t getNumberShards() const { return shards.size() ; }
+
+private:
+
+    static const uint32_t NO_SHARD = 0xFFFFFFFF ;
+
+    struct Shard {
+        std::mutex mtx ;
+        Tree tree ;
+    } ;
+
+    struct Stripe {
+        std::mutex mtx ;
+        FlatHashMap<T, uint32_t, Hash> shardOf ; // extant lineages only
+    } ;
+
+    std::vector<std::unique_ptr<Shard>> shards ; // one allocation each: no false sharing of mutexes
+    std::vector<std::unique_ptr<Stripe>> stripes ;
+    LocationDictionary locations ;
+    std::mutex locationsMtx ; // also serialises new sampling schemes
+
+    Stripe& stripeOf( const T& lng ) { return *stripes[ Hash()( lng ) % stripes.size() ] ; }
+
+    uint32_t findShard( const T& lng ) {
+
+        Stripe& stripe = stripeOf( lng ) ;
+        std::lock_guard<std::mutex> lock( stripe.mtx ) ;
+        const uint32_t* shard = stripe.shardOf.find( lng ) ;
+        assert( shard != nullptr ) ; // must be extant
+        return *shard ;
+
+    }
+
+    void setShard( const T& lng, uint32_t shard ) {
+
+        Stripe& stripe = stripeOf( lng ) ;
+        std::lock_guard<std::mutex> lock( stripe.mtx ) ;
+        bool isNew = stripe.shardOf.insert( lng, shard ) ;
+        assert( isNew ) ; // lineage identifiers must be unique among extant lineages
+        (void) isNew ;
+
+    }
+
+    /*
+     Locks all shards, always in the same order (hence without deadlocks).
+     */
+    std::vector<std::unique_lock<std::mutex>> lockShards() {
+
+        std::vector<std::unique_lock<std::mutex>> locks ;
+        locks.reserve( shards.size() ) ;
+        for ( auto& shard : shards )
+            locks.push_back( std::unique_lock<std::mutex>( shard->mtx ) ) ;
+        return locks ;
+
+    }
+
+} ;
+
+#endif /* concurrent_tree_hpp */
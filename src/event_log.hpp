@@ -0,0 +1,397 @@
+//
+//  event_log.hpp
+//  BDmodel
+//
+
+#ifndef event_log_hpp
+#define event_log_hpp
+
+#include "tree.hpp"
+#include "binary_io.hpp"
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <random>
+#include <string>
+#include <type_traits>
+
+
+//====== Logged events ======//
+
+/*
+
+ Events of an epidemic simulation, as recorded in an event log:
+
+    - EVENT_INTRODUCTION: lineage 'lng' appears at time 't' with no parent.
+    - EVENT_TRANSMISSION: lineage 'lng' is infected by 'lngParent' at time 't'.
+    - EVENT_SAMPLING: lineage 'lng' is sampled at time 't' in 'locSample'.
+    - EVENT_REMOVAL: lineage 'lng' is removed at time 't'.
+
+ These are exactly the calls a simulator makes to 'LineageTree', hence a
+ log can be replayed into a tree without running the simulation again.
+
+ */
+
+enum LoggedEventType {
+    EVENT_INTRODUCTION = 0,
+    EVENT_TRANSMISSION = 1,
+    EVENT_SAMPLING = 2,
+    EVENT_REMOVAL = 3
+} ;
+
+template <typename T>
+struct LoggedEvent {
+
+    LoggedEventType type ;
+    double t ;
+    T lng ;
+    T lngParent ; // transmissions only
+    LocationID locSample ; // sampling only
+
+} ;
+
+
+//====== EventLogWriter ======//
+
+/*
+
+ Appends events to a compact binary log (e.g. a file opened in binary mode).
+
+ Events are delta-encoded:
+    - times are XOR-ed with the time of the previous event and only the
+      significant bytes are kept (their number is stored with the type of
+      event in a one-byte header), hence close times share their leading
+      bytes and events at the same time (e.g. sampling then removal) take
+      no time bytes at all;
+    - identifiers are stored relative to the last NEW lineage (introduced
+      or infected) as variable-length integers (7 bits per byte), hence
+      counter identifiers (as in 'Simulator') mostly take one to three bytes.
+ Times are stored exactly, hence replayed trees are identical to those of
+ the original simulation.
+
+ Identifiers must be integral (see 'LineageTree' checkpoints for other types).
+
+ */
+
+template <typename T>
+class EventLogWriter {
+public:
+
+    static_assert( std::is_integral<T>::value, "event logs require integral lineage identifiers" ) ;
+
+    explicit EventLogWriter( std::ostream& out ): out( out ), tPrev( 0. ), lngLast( 0 ), nevents( 0 ) {
+
+        BinaryWriter header( out ) ;
+        header.writeString( eventLogTag() ) ;
+        header.write<uint32_t>( EVENT_LOG_VERSION ) ;
+        header.write<uint32_t>( sizeof( T ) ) ;
+
+    } ;
+
+    void introduction( const double& t, const T& lng ) { append( EVENT_INTRODUCTION, t, lng, lng, LOCATION_NA ) ; }
+    void transmission( const double& t, const T& lng, const T& lngParent ) { append( EVENT_TRANSMISSION, t, lng, lngParent, LOCATION_NA ) ; }
+    void sampling( const double& t, const T& lng, LocationID locSample = LOCATION_DEFAULT ) { append( EVENT_SAMPLING, t, lng, lng, locSample ) ; }
+    void removal( const double& t, const T& lng ) { append( EVENT_REMOVAL, t, lng, lng, LOCATION_NA ) ; }
+
+    uint64_t size() const { return nevents ; } // number of events written
+    bool good() const { return out.good() ; }
+    void flush() { out.flush() ; }
+
+    static const char* eventLogTag() { return "EventLog" ; }
+    enum { EVENT_LOG_VERSION = 1 } ;
+
+private:
+    std::ostream& out ;
+    double tPrev ;
+    int64_t lngLast ; // last new lineage
+    uint64_t nevents ;
+
+    void append( LoggedEventType type, const double& t, const T& lng, const T& lngParent, LocationID locSample ) {
+
+        char buffer[48] ; // header, time and 3 varints of at most 10 bytes
+        char* p = buffer ;
+
+        uint64_t dt = timeBits( t ) ^ timeBits( tPrev ) ;
+        unsigned nbytes = 0 ; // significant bytes of 'dt'
+        while ( nbytes < 8 and ( dt >> ( 8 * nbytes ) ) != 0 )
+            ++nbytes ;
+        *p++ = static_cast<char>( type | ( nbytes << 2 ) ) ;
+        for ( unsigned k = 0; k < nbytes; ++k )
+            *p++ = static_cast<char>( ( dt >> ( 8 * k ) ) & 0xFF ) ;
+
+        if ( type == EVENT_INTRODUCTION or type == EVENT_TRANSMISSION ) { // new lineage
+            if ( type == EVENT_TRANSMISSION )
+                p = putVarint( p, zigzag( static_cast<int64_t>( lngParent ) - lngLast ) ) ;
+            p = putVarint( p, zigzag( static_cast<int64_t>( lng ) - lngLast ) ) ;
+            lngLast = static_cast<int64_t>( lng ) ;
+        }
+        else
+            p = putVarint( p, zigzag( static_cast<int64_t>( lng ) - lngLast ) ) ;
+
+        if ( type == EVENT_SAMPLING )
+            p = putVarint( p, locSample ) ;
+
+        out.write( buffer, p - buffer ) ;
+        tPrev = t ;
+        ++nevents ;
+
+    }
+
+    static uint64_t timeBits( const double& t ) {
+
+        uint64_t bits ;
+        std::memcpy( &bits, &t, sizeof( bits ) ) ;
+        return bits ;
+
+    }
+
+    static uint64_t zigzag( int64_t x ) { return ( static_cast<uint64_t>( x ) << 1 ) ^ static_cast<uint64_t>( x >> 63 ) ; }
+
+    static char* putVarint( char* p, uint64_t x ) {
+
+        while ( x >= 0x80 ) {
+            *p++ = static_cast<char>( ( x & 0x7F ) | 0x80 ) ;
+            x >>= 7 ;
+        }
+        *p++ = static_cast<char>( x ) ;
+        return p ;
+
+    }
+
+} ;
+
+
+//====== EventLogReader ======//
+
+/*
+
+ Reads the events of a log written by 'EventLogWriter' from a block of
+ memory (typically a 'MappedFile'), one at a time.
+
+ 'next' returns 'false' at the end of the log, or if the log is invalid
+ (then 'ok' returns 'false' too, e.g. for a truncated last event).
+
+ */
+
+template <typename T>
+class EventLogReader {
+public:
+
+    static_assert( std::is_integral<T>::value, "event logs require integral lineage identifiers" ) ;
+
+    EventLogReader( const char* data, std::size_t size ): data( data ), size( size ), pos( 0 ), failed( false ), tPrev( 0. ), lngLast( 0 ) {
+
+        BinaryReader header( data, size ) ;
+        if ( header.readString() != EventLogWriter<T>::eventLogTag()
+             or header.read<uint32_t>() != EventLogWriter<T>::EVENT_LOG_VERSION
+             or header.read<uint32_t>() != sizeof( T ) or !header.ok() )
+            failed = true ;
+        pos = header.position() ;
+
+    } ;
+
+    bool next( LoggedEvent<T>& ev ) {
+
+        if ( failed or pos == size )
+            return false ;
+
+        uint8_t header = static_cast<uint8_t>( data[pos++] ) ;
+        unsigned nbytes = header >> 2 ;
+        if ( nbytes > 8 or nbytes > size - pos )
+            return fail() ;
+
+        ev.type = static_cast<LoggedEventType>( header & 3 ) ;
+        uint64_t dt = 0 ;
+        for ( unsigned k = 0; k < nbytes; ++k )
+            dt |= static_cast<uint64_t>( static_cast<uint8_t>( data[pos++] ) ) << ( 8 * k ) ;
+        uint64_t bits = timeBits( tPrev ) ^ dt ;
+        std::memcpy( &ev.t, &bits, sizeof( bits ) ) ;
+
+        if ( ev.type == EVENT_TRANSMISSION )
+            ev.lngParent = static_cast<T>( lngLast + unzigzag( getVarint() ) ) ;
+        ev.lng = static_cast<T>( lngLast + unzigzag( getVarint() ) ) ;
+        if ( ev.type == EVENT_INTRODUCTION or ev.type == EVENT_TRANSMISSION )
+            lngLast = static_cast<int64_t>( ev.lng ) ;
+        if ( ev.type != EVENT_TRANSMISSION )
+            ev.lngParent = ev.lng ;
+
+        ev.locSample = LOCATION_NA ;
+        if ( ev.type == EVENT_SAMPLING ) {
+            uint64_t loc = getVarint() ;
+            if ( loc > 0xFFFF )
+                return fail() ;
+            ev.locSample = static_cast<LocationID>( loc ) ;
+        }
+
+        if ( failed )
+            return false ;
+        tPrev = ev.t ;
+        return true ;
+
+    }
+
+    bool ok() const { return !failed ; }
+
+private:
+    const char* data ;
+    std::size_t size ;
+    std::size_t pos ;
+    bool failed ;
+    double tPrev ;
+    int64_t lngLast ;
+
+    bool fail() {
+
+        failed = true ;
+        return false ;
+
+    }
+
+    uint64_t getVarint() {
+
+        uint64_t x = 0 ;
+        for ( unsigned shift = 0; shift < 64; shift += 7 ) {
+
+            if ( pos == size ) // truncated
+                break ;
+            uint8_t byte = static_cast<uint8_t>( data[pos++] ) ;
+            x |= static_cast<uint64_t>( byte & 0x7F ) << shift ;
+            if ( ( byte & 0x80 ) == 0 )
+                return x ;
+
+        }
+        failed = true ;
+        return 0 ;
+
+    }
+
+    static uint64_t timeBits( const double& t ) {
+
+        uint64_t bits ;
+        std::memcpy( &bits, &t, sizeof( bits ) ) ;
+        return bits ;
+
+    }
+
+    static int64_t unzigzag( uint64_t x ) { return static_cast<int64_t>( x >> 1 ) ^ -static_cast<int64_t>( x & 1 ) ; }
+
+} ;
+
+
+//====== Replay ======//
+
+/*
+
+ Sampling rules decide which lineages are sampled when a log is replayed.
+ A rule is called on every SAMPLING and REMOVAL event:
+
+    bool operator()( const LoggedEvent<T>& ev, LocationID& locSample ) ;
+
+ and returns 'true' to sample 'ev.lng' at time 'ev.t' in 'locSample'
+ (set to 'ev.locSample' beforehand).
+
+    - 'RecordedSampling' keeps the sampling events of the log, i.e. gives
+      back the trees of the original simulation.
+    - 'BernoulliSampling' ignores them and samples every removed lineage
+      with probability 'p' (own generator, seeded by 'seed').
+
+ Custom rules may e.g. depend on time (sampling windows) or combine both.
+
+ */
+
+struct RecordedSampling {
+
+    template <typename T>
+    bool operator()( const LoggedEvent<T>& ev, LocationID& ) const { return ev.type == EVENT_SAMPLING ; }
+
+} ;
+
+struct BernoulliSampling {
+
+    BernoulliSampling( double p, uint64_t seed = 1 ): p( p ), mt( seed ), uni( 0., 1. ) {} ;
+
+    template <typename T>
+    bool operator()( const LoggedEvent<T>& ev, LocationID& locSample ) {
+
+        locSample = LOCATION_DEFAULT ;
+        return ev.type == EVENT_REMOVAL and uni( mt ) < p ;
+
+    }
+
+    double p ;
+    std::mt19937_64 mt ;
+    std::uniform_real_distribution<double> uni ;
+
+} ;
+
+/*
+
+ Replays the events of 'log' into 'tree' (usually empty), sampling the
+ lineages chosen by 'rule'. Stops after the first 'maxSamples' samples
+ (if positive) and the removal that follows, as 'Simulator' does with
+ 'max_samples'.
+
+ Returns the number of lineages sampled, or -1 if the log is invalid
+ (the tree then holds the events read so far).
+
+ N.B. locations are logged as IDs: sampling locations other than the
+ default one must be added to 'tree' beforehand, in the same order as in
+ the original tree (see 'LineageTree::addLocation').
+
+ */
+
+template <typename T, typename U, class Hash, class Index, class Layout, class Rule>
+long replayEventLog( EventLogReader<T>& log, LineageTree<T,U,Hash,Index,Layout>& tree, Rule& rule, long maxSamples = 0, const U& data = U() ) {
+
+    long nsampled = 0 ;
+    bool done = false ; // 'maxSamples' reached: only the removal of the last sample is left
+    LoggedEvent<T> ev ;
+    T lngLast = T() ;
+
+    while ( log.next( ev ) ) {
+
+        if ( done and ( ev.type != EVENT_REMOVAL or ev.lng != lngLast ) )
+            return nsampled ;
+
+        switch ( ev.type ) {
+
+            case EVENT_INTRODUCTION:
+                tree.addExtantLineageExternal( ev.t, ev.lng, data ) ;
+                break ;
+
+            case EVENT_TRANSMISSION:
+                tree.addExtantLineage( ev.t, ev.lng, data, ev.lngParent ) ;
+                break ;
+
+            case EVENT_SAMPLING:
+            case EVENT_REMOVAL: {
+                LocationID locSample = ev.locSample ;
+                if ( !done and rule( ev, locSample ) and tree.sampleExtantLineage( ev.lng, ev.t, locSample ) ) {
+                    done = ( ++nsampled == maxSamples ) ;
+                    lngLast = ev.lng ;
+                }
+                if ( ev.type == EVENT_REMOVAL ) {
+                    tree.removeExtantLineage( ev.lng ) ;
+                    if ( done )
+                        return nsampled ;
+                }
+                break ;
+            }
+
+        }
+
+    }
+
+    return log.ok() ? nsampled : -1 ;
+
+}
+
+template <typename T, typename U, class Hash, class Index, class Layout>
+long replayEventLog( EventLogReader<T>& log, LineageTree<T,U,Hash,Index,Layout>& tree, long maxSamples = 0 ) {
+
+    RecordedSampling rule ;
+    return replayEventLog( log, tree, rule, maxSamples ) ;
+
+}
+
+#endif /* event_log_hpp */
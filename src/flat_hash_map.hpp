@@ -0,0 +1,322 @@
+//
+//  flat_hash_map.hpp
+//  BDmodel
+//
+
+#ifndef flat_hash_map_hpp
+#define flat_hash_map_hpp
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+
+//====== FlatHashMap ======//
+
+/*
+
+ Open-addressing hash map with robin-hood probing.
+
+ Entries are stored inline in a single array (no allocation per entry).
+ Deletion shifts the following entries back by one slot instead of
+ leaving tombstones, hence lookups never slow down after many
+ insertions/deletions, which is the typical usage pattern of lineage
+ identifiers during a simulation.
+
+ 'Hash' is the user-supplied hash for 'K'; its output is scrambled with a
+ multiplicative (Fibonacci) step, so weak hashes such as the identity
+ hash of integers are fine.
+
+ N.B. 'K' and 'V' must be default-constructible. Inserting or erasing
+ invalidates iterators and pointers returned by 'find'.
+
+ */
+
+template <typename K, typename V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+class FlatHashMap {
+public:
+
+    typedef std::pair<K,V> value_type ;
+
+    FlatHashMap(): nitems( 0 ), shift( 64 ) {} ;
+
+    V* find( const K& key ) {
+
+        std::size_t ix = findSlot( key ) ;
+        return ( ix != NOT_FOUND ) ? &slots[ix].second : nullptr ;
+
+    }
+
+    const V* find( const K& key ) const {
+
+        std::size_t ix = findSlot( key ) ;
+        return ( ix != NOT_FOUND ) ? &slots[ix].second : nullptr ;
+
+    }
+
+    bool contains( const K& key ) const { return findSlot( key ) != NOT_FOUND ; }
+
+    /*
+     Inserts ('key','value') if 'key' is not present.
+     Returns 'false' (and leaves the map unchanged) otherwise.
+     */
+    bool insert( const K& key, const V& value ) {
+
+        if ( findSlot( key ) != NOT_FOUND )
+            return false ;
+
+        insertNew( value_type( key, value ) ) ;
+        return true ;
+
+    }
+
+    V& operator[]( const K& key ) {
+
+        std::size_t ix = findSlot( key ) ;
+        if ( ix == NOT_FOUND ) {
+            insertNew( value_type( key, V() ) ) ;
+            ix = findSlot( key ) ; // entries may have moved
+        }
+        return slots[ix].second ;
+
+    }
+
+    /*
+     Removes 'key' (if present) using backward-shift deletion.
+     Returns 'true' if 'key' was found.
+     */
+    bool erase( const K& key ) {
+
+        std::size_t ix = findSlot( key ) ;
+        if ( ix == NOT_FOUND )
+            return false ;
+
+        eraseSlot( ix ) ;
+        return true ;
+
+    }
+
+    /*
+     Moves the value associated with 'key' into 'value' and removes 'key',
+     with a single probe. Returns 'false' (and leaves 'value' unchanged)
+     if 'key' is not present.
+     */
+    bool take( const K& key, V& value ) {
+
+        std::size_t ix = findSlot( key ) ;
+        if ( ix == NOT_FOUND )
+            return false ;
+
+        value = std::move( slots[ix].second ) ;
+        eraseSlot( ix ) ;
+        return true ;
+
+    }
+
+    std::size_t size() const { return nitems ; }
+    bool empty() const { return nitems == 0 ; }
+    std::size_t capacity() const { return slots.size() ; }
+
+    void clear() { // keeps capacity
+
+        for ( std::size_t ix = 0; ix < slots.size(); ++ix ) {
+            if ( dist[ix] != 0 ) {
+                slots[ix] = value_type() ;
+                dist[ix] = 0 ;
+            }
+        }
+        nitems = 0 ;
+
+    }
+
+    /*
+     Makes room for 'n' entries without further rehashing.
+     */
+    void reserve( std::size_t n ) {
+
+        std::size_t cap = slots.empty() ? MIN_CAPACITY : slots.size() ;
+        while ( n * MAX_LOAD_DEN > cap * MAX_LOAD_NUM )
+            cap *= 2 ;
+
+        if ( cap > slots.size() )
+            rehash( cap ) ;
+
+    }
+
+    class const_iterator {
+    public:
+        const_iterator( const FlatHashMap* map, std::size_t ix ): map( map ), ix( ix ) { skipEmpty() ; } ;
+        const value_type& operator*() const { return map->slots[ix] ; }
+        const value_type* operator->() const { return &map->slots[ix] ; }
+        const_iterator& operator++() { ++ix ; skipEmpty() ; return *this ; }
+        bool operator==( const const_iterator& other ) const { return ix == other.ix ; }
+        bool operator!=( const const_iterator& other ) const { return ix != other.ix ; }
+    private:
+        void skipEmpty() { while ( ix < map->slots.size() and map->dist[ix] == 0 ) ++ix ; }
+        const FlatHashMap* map ;
+        std::size_t ix ;
+    } ;
+
+    const_iterator begin() const { return const_iterator( this, 0 ) ; }
+    const_iterator end() const { return const_iterator( this, slots.size() ) ; }
+
+private:
+
+    static const std::size_t NOT_FOUND = static_cast<std::size_t>( -1 ) ;
+    static const std::size_t MIN_CAPACITY = 8 ;
+    static const std::size_t MAX_LOAD_NUM = 4 ; // maximum load factor is 4/5
+    static const std::size_t MAX_LOAD_DEN = 5 ;
+
+    std::vector<value_type> slots ;
+    std::vector<uint32_t> dist ; // 0 if slot is empty, else 1 + distance from ideal slot
+    std::size_t nitems ;
+    unsigned shift ; // 64 - log2( capacity )
+
+    void eraseSlot( std::size_t ix ) {
+
+        std::size_t mask = slots.size() - 1 ;
+        std::size_t next = ( ix + 1 ) & mask ;
+        while ( dist[next] > 1 ) { // shift back entries displaced from their ideal slot
+
+            slots[ix] = std::move( slots[next] ) ;
+            dist[ix] = dist[next] - 1 ;
+            ix = next ;
+            next = ( next + 1 ) & mask ;
+
+        }
+
+        slots[ix] = value_type() ; // releases resources held by the entry
+        dist[ix] = 0 ;
+        --nitems ;
+
+    }
+
+    std::size_t idealSlot( const K& key ) const {
+
+        uint64_t h = static_cast<uint64_t>( Hash()( key ) ) ;
+        return static_cast<std::size_t>( ( h * 0x9E3779B97F4A7C15ull ) >> shift ) ;
+
+    }
+
+    std::size_t findSlot( const K& key ) const {
+
+        if ( nitems == 0 )
+            return NOT_FOUND ;
+
+        std::size_t mask = slots.size() - 1 ;
+        std::size_t ix = idealSlot( key ) ;
+        uint32_t d = 1 ;
+        while ( dist[ix] >= d ) { // robin-hood invariant: stop at the first poorer entry
+
+            if ( dist[ix] == d and KeyEqual()( slots[ix].first, key ) )
+                return ix ;
+            ix = ( ix + 1 ) & mask ;
+            ++d ;
+
+        }
+        return NOT_FOUND ;
+
+    }
+
+    void insertNew( value_type entry ) {
+
+        if ( ( nitems + 1 ) * MAX_LOAD_DEN > slots.size() * MAX_LOAD_NUM )
+            rehash( slots.empty() ? MIN_CAPACITY : 2 * slots.size() ) ;
+
+        std::size_t mask = slots.size() - 1 ;
+        std::size_t ix = idealSlot( entry.first ) ;
+        uint32_t d = 1 ;
+        while ( true ) {
+
+            if ( dist[ix] == 0 ) { // empty slot
+
+                slots[ix] = std::move( entry ) ;
+                dist[ix] = d ;
+                ++nitems ;
+                return ;
+
+            }
+
+            if ( dist[ix] < d ) { // take the slot from a richer entry and carry on with it
+
+                std::swap( slots[ix], entry ) ;
+                std::swap( dist[ix], d ) ;
+
+            }
+
+            ix = ( ix + 1 ) & mask ;
+            ++d ;
+
+        }
+
+    }
+
+    void rehash( std::size_t newCapacity ) {
+
+        assert( ( newCapacity & ( newCapacity - 1 ) ) == 0 ) ; // power of 2
+
+        std::vector<value_type> oldSlots( newCapacity ) ;
+        std::vector<uint32_t> oldDist( newCapacity, 0 ) ;
+        oldSlots.swap( slots ) ;
+        oldDist.swap( dist ) ;
+
+        shift = 64 ;
+        for ( std::size_t cap = newCapacity; cap > 1; cap >>= 1 )
+            --shift ;
+
+        nitems = 0 ;
+        for ( std::size_t ix = 0; ix < oldSlots.size(); ++ix ) {
+            if ( oldDist[ix] != 0 )
+                insertNew( std::move( oldSlots[ix] ) ) ;
+        }
+
+    }
+
+} ;
+
+
+//====== FlatHashSet ======//
+
+/*
+
+ Set counterpart of 'FlatHashMap' (same requirements and guarantees).
+
+ */
+
+template <typename K, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+class FlatHashSet {
+public:
+
+    typedef FlatHashMap<K, bool, Hash, KeyEqual> map_type ;
+
+    bool insert( const K& key ) { return map.insert( key, true ) ; }
+    bool erase( const K& key ) { return map.erase( key ) ; }
+    bool contains( const K& key ) const { return map.contains( key ) ; }
+    std::size_t size() const { return map.size() ; }
+    bool empty() const { return map.empty() ; }
+    void clear() { map.clear() ; }
+    void reserve( std::size_t n ) { map.reserve( n ) ; }
+
+    class const_iterator {
+    public:
+        const_iterator( typename map_type::const_iterator it ): it( it ) {} ;
+        const K& operator*() const { return it->first ; }
+        const K* operator->() const { return &it->first ; }
+        const_iterator& operator++() { ++it ; return *this ; }
+        bool operator==( const const_iterator& other ) const { return it == other.it ; }
+        bool operator!=( const const_iterator& other ) const { return it != other.it ; }
+    private:
+        typename map_type::const_iterator it ;
+    } ;
+
+    const_iterator begin() const { return const_iterator( map.begin() ) ; }
+    const_iterator end() const { return const_iterator( map.end() ) ; }
+
+private:
+    map_type map ;
+
+} ;
+
+#endif /* flat_hash_map_hpp */
@@ -0,0 +1,157 @@
+//
+//  number_format.hpp
+//  BDmodel
+//
+
+#ifndef number_format_hpp
+#define number_format_hpp
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <type_traits>
+
+
+//====== Integers ======//
+
+/*
+
+ Integer types written by 'formatInteger' (character types and 'bool' are
+ written by streams as characters or words, hence left to them).
+
+ */
+
+template <typename I>
+struct IsDecimalInteger {
+
+    static const bool value = std::is_integral<I>::value and !std::is_same<I, bool>::value
+                              and !std::is_same<I, char>::value and !std::is_same<I, signed char>::value
+                              and !std::is_same<I, unsigned char>::value and !std::is_same<I, wchar_t>::value
+                              and !std::is_same<I, char16_t>::value and !std::is_same<I, char32_t>::value ;
+
+} ;
+
+/*
+
+ Writes 'value' in decimal to 'buffer' (at least 24 characters, no final
+ '\0'), as streams do, and returns the number of characters written.
+
+ */
+
+template <typename I>
+std::size_t formatInteger( char* buffer, I value ) {
+
+    static_assert( IsDecimalInteger<I>::value, "not a decimal integer type" ) ;
+    typedef typename std::make_unsigned<I>::type UI ;
+
+    bool negative = value < 0 ;
+    UI magnitude = negative ? static_cast<UI>( UI( 0 ) - static_cast<UI>( value ) ) : static_cast<UI>( value ) ; // also for the most negative value
+
+    char digits[24] ;
+    std::size_t n = 0 ;
+    do {
+        digits[n++] = static_cast<char>( '0' + magnitude % 10 ) ;
+        magnitude /= 10 ;
+    } while ( magnitude != 0 ) ;
+
+    std::size_t len = 0 ;
+    if ( negative )
+        buffer[len++] = '-' ;
+    while ( n > 0 )
+        buffer[len++] = digits[--n] ;
+    return len ;
+
+}
+
+
+//====== Floating point ======//
+
+/*
+
+ Buffer size of 'formatFixed' and 'formatShortest' (large enough for any
+ double with up to 'MAX_FIXED_PRECISION' decimals).
+
+ */
+
+enum { NUMBER_BUFFER_SIZE = 384, MAX_FIXED_PRECISION = 17 } ;
+
+/*
+
+ Writes 'x' to 'buffer' with 'precision' decimals (at most
+ 'MAX_FIXED_PRECISION'), exactly as printf's "%.*f" (e.g. 'std::to_string'
+ for 6 decimals), and returns the number of characters written.
+
+ Non-negative values below 1e9 with at most 9 decimals are scaled and
+ rounded as integers. The scaled value is within one unit in the last
+ place of the exact product, hence both round the same way unless its
+ fraction is that close to one half: such cases (and all others) go
+ through 'snprintf'.
+
+ */
+
+inline std::size_t formatFixed( char* buffer, double x, int precision ) {
+
+    static const double scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 } ;
+    static const uint64_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 } ;
+
+    if ( precision >= 0 and precision <= 9 and x >= 0. and x < 1e9 and !std::signbit( x ) ) {
+
+        double scaled = x * scales[precision] ;
+        double integral = std::floor( scaled ) ;
+        double fraction = scaled - integral ;
+
+        if ( std::fabs( fraction - 0.5 ) > 4.5e-16 * scaled ) { // rounding direction is certain
+
+            uint64_t rounded = static_cast<uint64_t>( integral ) + ( fraction > 0.5 ? 1 : 0 ) ;
+            uint64_t whole = rounded / powers[precision] ;
+            uint64_t decimals = rounded % powers[precision] ;
+
+            std::size_t len = formatInteger( buffer, whole ) ;
+            if ( precision > 0 ) {
+                buffer[len++] = '.' ;
+                for ( int k = precision - 1; k >= 0; --k ) {
+                    buffer[len + k] = static_cast<char>( '0' + decimals % 10 ) ;
+                    decimals /= 10 ;
+                }
+                len += precision ;
+            }
+            return len ;
+
+        }
+
+    }
+
+    int len = std::snprintf( buffer, NUMBER_BUFFER_SIZE, "%.*f", precision, x ) ;
+    return ( len > 0 ) ? static_cast<std::size_t>( len ) : 0 ;
+
+}
+
+/*
+
+ Writes the shortest decimal representation of 'x' that reads back as
+ the same double (e.g. "0.1" rather than "0.100000" or "0.10000000000000001"),
+ in printf's "%g" notation, and returns the number of characters written.
+
+ Values with at most 15 significant digits (e.g. times read from data or
+ rounded dates) are written by a single 'snprintf': "%.15g" drops
+ trailing zeros, and is the shortest exact representation whenever one
+ with 15 digits or fewer exists. Other values (most simulated times) need
+ up to three calls, hence this format is slower than 'formatFixed'.
+
+ */
+
+inline std::size_t formatShortest( char* buffer, double x ) {
+
+    int len = 0 ;
+    for ( int digits = 15; digits <= 17; ++digits ) {
+        len = std::snprintf( buffer, NUMBER_BUFFER_SIZE, "%.*g", digits, x ) ;
+        if ( digits == 17 or std::strtod( buffer, nullptr ) == x or x != x ) // 17 digits always read back (except NaN)
+            break ;
+    }
+    return ( len > 0 ) ? static_cast<std::size_t>( len ) : 0 ;
+
+}
+
+#endif /* number_format_hpp */
@@ -6,13 +6,26 @@
 //
 
 #include "pysimBD.hpp"
+#include <stdexcept>
 
+/*
+ Simulator reused by successive calls (one per thread): 'reset' keeps the memory
+ of the previous replicate (node pool, lineage index, list of infected lineages),
+ hence replicates do not re-grow these tables from scratch.
+ */
+static Simulator& simulation_context( double R0, double dI, double rho ) {
+    
+    static thread_local Simulator simulator( R0, dI, rho ) ;
+    simulator.reset( R0, dI, rho ) ;
+    return simulator ;
+    
+}
 
 std::string simulate_BD( int seed, int max_cases, int max_samples, double R0, double dI, double rho ) {
     
     m_mt.seed( seed ) ;
     
-    Simulator simulator = Simulator( R0, dI, rho ) ;
+    Simulator& simulator = simulation_context( R0, dI, rho ) ;
     
     simulator.set_max_cases( max_cases ) ;
     simulator.set_max_samples( max_samples ) ;
@@ -24,9 +37,9 @@ std::string simulate_BD( int seed, int max_cases, int max_samples, double R0, do
         
         // The following lines explain how to extract a phylogenetic tree
         LineageTree<int,int>* tree_mngr = simulator.get_tree() ;
-        LineageTreeNode<int,int>* rtree = tree_mngr->subSampleTree()[0] ; // obtained the reduced transmission tree (removes all nodes that are not necessary to construct a phylogenetic tree given sampled nodes.
-        PhyloNode<int,int>* atree = getAncestralTree( rtree ) ; // extracts the phylogenetic tree
-        std::string nwk = getSimpleNewick( atree ) ; // newick string representation of phylogenetic tree
+        ReducedForest<int,int> rtrees( tree_mngr->subSampleTree() ) ; // obtained the reduced transmission trees (removes all nodes that are not necessary to construct a phylogenetic tree given sampled nodes. Freed at the end of the scope.
+        PhyloTree<int,int> atree( getAncestralTree( rtrees[0] ) ) ; // extracts the phylogenetic tree (freed at the end of the scope)
+        std::string nwk = getSimpleNewick( atree.get() ) ; // newick string representation of phylogenetic tree
         return nwk ;
         
     }
@@ -34,3 +47,120 @@ std::string simulate_BD( int seed, int max_cases, int max_samples, double R0, do
         return "" ;
     
 }
+
+/*
+ Same as 'simulate_BD', the tree being written to 'path' as it is formatted
+ (see 'writeSimpleNewick'), hence without holding its newick string in memory.
+ */
+bool simulate_BD_to_file( int seed, int max_cases, int max_samples, double R0, double dI, double rho, const std::string& path ) {
+    
+    bool gzip = path.size() > 3 and path.compare( path.size() - 3, 3, ".gz" ) == 0 ;
+#ifndef TREE_ZLIB
+    if ( gzip ) // rejected before the file is created or truncated
+        throw std::runtime_error( "cannot write " + path + ": built without TREE_ZLIB (gzip unavailable)" ) ;
+#endif
+    
+    m_mt.seed( seed ) ;
+    
+    Simulator& simulator = simulation_context( R0, dI, rho ) ;
+    
+    simulator.set_max_cases( max_cases ) ;
+    simulator.set_max_samples( max_samples ) ;
+    
+    simulator.initialise_single_infection() ;
+    
+    if ( !simulator.simulate() ) // a simulation may fail due to early extinction
+        return false ;
+    
+    LineageTree<int,int>* tree_mngr = simulator.get_tree() ;
+    ReducedForest<int,int> rtrees( tree_mngr->subSampleTree() ) ;
+    FlatPhylogeny<int,int> atree ;
+    getAncestralTree( rtrees[0], atree ) ;
+    
+    FileSink file ;
+    if ( !file.open( path ) )
+        return false ;
+    
+    bool ok = false ;
+    if ( gzip ) { // only with zlib (see above)
+#ifdef TREE_ZLIB
+        GzipSink gz( file ) ;
+        ok = writeSimpleNewick( gz, atree ) and gz.close() ;
+#endif
+    }
+    else
+        ok = writeSimpleNewick( file, atree ) ;
+    
+    return file.close() and ok ;
+    
+}
+
+BDPhylogeny simulate_BD_phylogeny( int seed, int max_cases, int max_samples, double R0, double dI, double rho ) {
+    
+    m_mt.seed( seed ) ;
+    
+    Simulator& simulator = simulation_context( R0, dI, rho ) ;
+    
+    simulator.set_max_cases( max_cases ) ;
+    simulator.set_max_samples( max_samples ) ;
+    
+    simulator.initialise_single_infection() ;
+    
+    BDPhylogeny res ;
+    if ( simulator.simulate() ) {
+        
+        LineageTree<int,int>* tree_mngr = simulator.get_tree() ;
+        ReducedForest<int,int> rtrees( tree_mngr->subSampleTree() ) ;
+        getAncestralTree( rtrees[0], res.tree ) ; // arrays, no node allocations
+        res.labels.assign( res.tree.lng.begin(), res.tree.lng.end() ) ;
+        
+    }
+    
+    return res ;
+    
+}
+
+BDStats simulate_BD_stats( int seed, int max_cases, int max_samples, double R0, double dI, double rho, double stats_interval ) {
+    
+    m_mt.seed( seed ) ;
+    
+    Simulator& simulator = simulation_context( R0, dI, rho ) ;
+    
+    simulator.set_max_cases( max_cases ) ;
+    simulator.set_max_samples( max_samples ) ;
+    simulator.set_stats_interval( stats_interval ) ;
+    
+    simulator.initialise_single_infection() ;
+    
+    std::atomic<uint64_t> ancestralNanoseconds( 0 ) ; // this run only ('ancestralTreeStats' also counts other threads)
+    
+    BDStats res ;
+    bool success = simulator.simulate() ;
+    LineageTree<int,int>* tree_mngr = simulator.get_tree() ;
+    if ( success ) {
+        
+        ReducedForest<int,int> rtrees( tree_mngr->subSampleTree() ) ;
+        PhyloTree<int,int> atree ;
+        {
+            TREE_STATS_UPDATE( ScopedStatsTimer timer( ancestralNanoseconds ) ; )
+            atree.reset( getAncestralTree( rtrees[0] ) ) ;
+        }
+        res.tree = getSimpleNewick( atree.get() ) ;
+        
+    }
+    
+    const LineageTreeStats& stats = tree_mngr->getStats() ;
+    res.stats_enabled = stats.enabled ;
+    res.nodes_allocated = stats.nodesAllocated ;
+    res.nodes_freed = stats.nodesFreed ;
+    res.merges = stats.merges ;
+    res.peak_nodes = stats.peakNodes ;
+    res.bytes_per_node = stats.bytesPerNode ;
+    res.cascade_depths = stats.cascadeDepths ;
+    res.subsample_seconds = stats.subSampleSeconds ;
+    res.ancestral_seconds = 1e-9 * ancestralNanoseconds ;
+    res.series = simulator.get_stats_series() ;
+    
+    return res ;
+    
+}
@@ -17,5 +17,39 @@
 // max_cases sets a further stopping condition depending on the total number of cases: just set it to a very large number
 std::string simulate_BD( int seed, int max_cases, int max_samples, double R0, double dI, double rho ) ;
 
+// same as 'simulate_BD', streaming the newick tree to the file at 'path' instead of returning it (gzip-compressed if 'path' ends with ".gz",
+// which requires compiling with -DTREE_ZLIB and linking with -lz, otherwise such paths throw std::runtime_error before anything is written).
+// Returns false if the simulation or writing the file failed
+bool simulate_BD_to_file( int seed, int max_cases, int max_samples, double R0, double dI, double rho, const std::string& path ) ;
+
+// phylogenetic tree of 'simulate_BD_phylogeny' as parallel arrays (nodes in preorder, root first: see 'FlatPhylogeny'),
+// exported to python as NumPy arrays sharing this memory. 'labels' holds the lineage identifier of each node as int64
+struct BDPhylogeny {
+    FlatPhylogeny<int,int> tree ;
+    std::vector<int64_t> labels ;
+} ;
+
+// same as 'simulate_BD', returning the tree as arrays instead of a newick string (empty if the simulation failed)
+BDPhylogeny simulate_BD_phylogeny( int seed, int max_cases, int max_samples, double R0, double dI, double rho ) ;
+
+// outcome of 'simulate_BD_stats': the newick tree (empty if the simulation failed),
+// tracker statistics (zero unless compiled with -DTREE_STATS) and the time series sampled every 'stats_interval'
+struct BDStats {
+    std::string tree ;
+    bool stats_enabled ;
+    uint64_t nodes_allocated ;
+    uint64_t nodes_freed ;
+    uint64_t merges ;
+    uint64_t peak_nodes ;
+    std::size_t bytes_per_node ;
+    std::vector<uint64_t> cascade_depths ;
+    double subsample_seconds ;
+    double ancestral_seconds ;
+    TrackerSeries series ;
+} ;
+
+// same as 'simulate_BD', also collecting tracker statistics
+BDStats simulate_BD_stats( int seed, int max_cases, int max_samples, double R0, double dI, double rho, double stats_interval ) ;
+
 
 #endif /* pysimBD_hpp */
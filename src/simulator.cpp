@@ -6,6 +6,9 @@
 //
 
 #include "simulator.hpp"
+#include "binary_io.hpp"
+#include <fstream>
+#include <sstream>
 
 void rmv_element( std::vector<int>& v, int ix ) {
     
@@ -14,7 +17,28 @@ void rmv_element( std::vector<int>& v, int ix ) {
     
 }
 
-Simulator::Simulator(  double R0_, double dI_, double rho_ ): R0( R0_ ), dI( dI_ ), rho( rho_ ){
+Simulator::Simulator(  double R0_, double dI_, double rho_ ) {
+    
+    I_lngs.reserve( 10000 ) ;
+    
+    tree_mngr = new LineageTree<int,int>() ;
+    tree_mngr->reserve( I_lngs.capacity() ) ; // same initial capacity as the list of infected lineages
+    
+    reset( R0_, dI_, rho_ ) ;
+
+}
+
+Simulator::~Simulator() {
+    
+    delete tree_mngr ;
+    
+}
+
+void Simulator::reset( double R0_, double dI_, double rho_ ) {
+    
+    R0 = R0_ ;
+    dI = dI_ ;
+    rho = rho_ ;
     
     I = 0 ;
     t = 0. ;
@@ -23,20 +47,25 @@ Simulator::Simulator(  double R0_, double dI_, double rho_ ): R0( R0_ ), dI( dI_
     beta    = R0 * mu ;
     
     next_lng = 1 ;
-    I_lngs = {} ;
-    I_lngs.reserve( 10000 ) ;
+    I_lngs.clear() ; // keeps capacity
     n_sampled = 0 ;
     max_cases = 100000000 ;
     max_samples = 10 ;
+    stats_interval = 0. ;
+    next_stats_t = 0. ;
+    stats_series.clear() ;
+    event_log = nullptr ;
+    
+    tree_mngr->reset() ; // keeps node pool and index capacity
     
-    tree_mngr = new LineageTree<int,int>() ;
-
 }
 
 void Simulator::initialise_single_infection() {
     
     // must call addExtantLineageExternal whenever an introduction event occurs. 'next_lng' is the infected lineage and 't' is infection time. The third entry is just optional metadata: I simply set it to 0 because I am not interested in metadata.
     tree_mngr->addExtantLineageExternal( t, next_lng, 0 ) ;
+    if ( event_log != nullptr )
+        event_log->introduction( t, next_lng ) ;
     I_lngs.push_back( next_lng ) ;
     next_lng++ ;
     I++ ;
@@ -53,6 +82,33 @@ void Simulator::set_max_samples( int max_samples_ ) {
     max_samples = max_samples_ ;
 }
 
+void Simulator::set_stats_interval( double stats_interval_ ) {
+    
+    stats_interval = stats_interval_ ;
+    next_stats_t = t ;
+}
+
+void Simulator::set_event_log( EventLogWriter<int>* event_log_ ) {
+    
+    event_log = event_log_ ;
+}
+
+void Simulator::record_stats() {
+    
+    const LineageTreeStats& stats = tree_mngr->getStats() ;
+    
+    stats_series.t.push_back( t ) ;
+    stats_series.infected.push_back( I ) ;
+    stats_series.nodes.push_back( tree_mngr->getSizeNodes() ) ;
+    stats_series.nodes_allocated.push_back( stats.nodesAllocated ) ;
+    stats_series.nodes_freed.push_back( stats.nodesFreed ) ;
+    stats_series.merges.push_back( stats.merges ) ;
+    
+    while ( next_stats_t <= t ) // next point on the grid
+        next_stats_t += stats_interval ;
+    
+}
+
 
 bool Simulator::simulate() {
         
@@ -80,6 +136,9 @@ bool Simulator::simulate() {
             apply_removal( rho ) ;
         }
         
+        if ( stats_interval > 0. and t >= next_stats_t )
+            record_stats() ;
+        
         // stopping conditions
         if ( ( next_lng > max_cases ) ) {
             return false ;
@@ -102,6 +161,8 @@ void Simulator::apply_infection() {
     // update tree by selecting infector from I_lngs
     int ix_infector = getUniInt( I - 1 ) ;
     int lng_infector = I_lngs[ix_infector] ;
+    if ( event_log != nullptr )
+        event_log->transmission( t, next_lng, lng_infector ) ;
     tree_mngr->addExtantLineage( t, next_lng, 0, lng_infector ) ; // must call addExtantLineage whenever a transmission event occurs. 'next_lng' is the name of the lineage created during the transmission event, 'lng_infector' is the parent lineage, 't' is the time of infection. The third entry is just optional metadata: I simply set it to 0 because I am not interested in metadata.
         
     I_lngs.push_back( next_lng ) ;
@@ -118,12 +179,136 @@ void Simulator::apply_removal( double prob_sampling ) {
     if ( getBool( prob_sampling ) ) {
 
         tree_mngr->sampleExtantLineage( lng, t ) ; // marks lineage 'lng' as sampled at time 't'
+        if ( event_log != nullptr )
+            event_log->sampling( t, lng ) ;
         n_sampled++ ;
 
     }
     
+    if ( event_log != nullptr )
+        event_log->removal( t, lng ) ;
     tree_mngr->removeExtantLineage( lng ) ; // must call removeExtantLineage whenever a lineage (lng) is removed from the simulation
     rmv_element( I_lngs, ix ) ;
     I-- ;
     
 }
+
+static const char* CHECKPOINT_TAG = "Simulator" ;
+static const uint32_t CHECKPOINT_VERSION = 1 ;
+
+bool Simulator::save_checkpoint( const std::string& path ) const {
+    
+    std::ofstream file( path, std::ios::binary | std::ios::trunc ) ;
+    if ( !file )
+        return false ;
+    
+    BinaryWriter out( file ) ;
+    out.writeString( CHECKPOINT_TAG ) ;
+    out.write( CHECKPOINT_VERSION ) ;
+    
+    out.write( I ) ;
+    out.write( t ) ;
+    out.write( R0 ) ;
+    out.write( dI ) ;
+    out.write( rho ) ;
+    out.write( mu ) ;
+    out.write( beta ) ;
+    out.write( next_lng ) ;
+    out.writeVector( I_lngs ) ;
+    out.write( n_sampled ) ;
+    out.write( max_cases ) ;
+    out.write( max_samples ) ;
+    
+    out.write( stats_interval ) ;
+    out.write( next_stats_t ) ;
+    out.writeVector( stats_series.t ) ;
+    out.writeVector( stats_series.infected ) ;
+    out.writeVector( stats_series.nodes ) ;
+    out.writeVector( stats_series.nodes_allocated ) ;
+    out.writeVector( stats_series.nodes_freed ) ;
+    out.writeVector( stats_series.merges ) ;
+    
+    std::ostringstream rng ; // standard text form of the engine and distributions
+    rng << m_mt << ' ' << rand_uniform << ' ' << rand_expo ;
+    out.writeString( rng.str() ) ;
+    
+    tree_mngr->save( out ) ;
+    
+    file.flush() ;
+    return out.good() ;
+    
+}
+
+bool Simulator::load_checkpoint( const std::string& path ) {
+    
+    MappedFile file ;
+    if ( !file.open( path ) )
+        return false ;
+    
+    BinaryReader in( file.data(), file.size() ) ;
+    if ( in.readString() != CHECKPOINT_TAG or in.read<uint32_t>() != CHECKPOINT_VERSION )
+        return false ;
+    
+    // read into a copy, so that the simulator is left untouched if the file is invalid
+    int I_ = in.read<int>() ;
+    double t_ = in.read<double>() ;
+    double R0_ = in.read<double>() ;
+    double dI_ = in.read<double>() ;
+    double rho_ = in.read<double>() ;
+    double mu_ = in.read<double>() ;
+    double beta_ = in.read<double>() ;
+    int next_lng_ = in.read<int>() ;
+    std::vector<int> I_lngs_ ;
+    in.readVector( I_lngs_ ) ;
+    int n_sampled_ = in.read<int>() ;
+    int max_cases_ = in.read<int>() ;
+    int max_samples_ = in.read<int>() ;
+    
+    double stats_interval_ = in.read<double>() ;
+    double next_stats_t_ = in.read<double>() ;
+    TrackerSeries stats_series_ ;
+    in.readVector( stats_series_.t ) ;
+    in.readVector( stats_series_.infected ) ;
+    in.readVector( stats_series_.nodes ) ;
+    in.readVector( stats_series_.nodes_allocated ) ;
+    in.readVector( stats_series_.nodes_freed ) ;
+    in.readVector( stats_series_.merges ) ;
+    
+    std::mt19937_64 mt_ ;
+    std::uniform_real_distribution<double> uniform_ ;
+    std::exponential_distribution<double> expo_ ;
+    std::istringstream rng( in.readString() ) ;
+    rng >> mt_ >> uniform_ >> expo_ ;
+    
+    if ( !in.ok() or !rng or I_ != static_cast<int>( I_lngs_.size() ) )
+        return false ;
+    
+    LineageTree<int,int> tree ;
+    if ( !tree.load( in ) )
+        return false ;
+    
+    I = I_ ;
+    t = t_ ;
+    R0 = R0_ ;
+    dI = dI_ ;
+    rho = rho_ ;
+    mu = mu_ ;
+    beta = beta_ ;
+    next_lng = next_lng_ ;
+    I_lngs.swap( I_lngs_ ) ;
+    n_sampled = n_sampled_ ;
+    max_cases = max_cases_ ;
+    max_samples = max_samples_ ;
+    stats_interval = stats_interval_ ;
+    next_stats_t = next_stats_t_ ;
+    stats_series = stats_series_ ;
+    
+    m_mt = mt_ ;
+    rand_uniform = uniform_ ;
+    rand_expo = expo_ ;
+    
+    *tree_mngr = std::move( tree ) ; // 'get_tree' stays valid
+    
+    return true ;
+    
+}
@@ -9,25 +9,68 @@
 #define simulator_hpp
 
 #include "tree.hpp"
+#include "event_log.hpp"
 #include "random.hpp"
 #include <stdio.h>
+#include <string>
 #include <vector>
 
 void rmv_element( std::vector<int>& v, int ix ) ;
 
+/*
+ Time series of the state of the tree tracker, recorded during 'simulate' (see 'set_stats_interval').
+ Node counters come from LineageTree::getStats, hence they are zero unless compiled with TREE_STATS.
+ */
+struct TrackerSeries {
+    std::vector<double> t ;
+    std::vector<int> infected ;
+    std::vector<unsigned> nodes ;
+    std::vector<uint64_t> nodes_allocated ;
+    std::vector<uint64_t> nodes_freed ;
+    std::vector<uint64_t> merges ;
+    
+    void clear() { // keeps capacity
+        t.clear() ; infected.clear() ; nodes.clear() ;
+        nodes_allocated.clear() ; nodes_freed.clear() ; merges.clear() ;
+    }
+} ;
+
 class Simulator {
 public:
     Simulator( double R0, double dI, double rho ) ;
+    ~Simulator() ;
+    
+    Simulator( const Simulator& ) = delete ; // owns the tree tracker
+    Simulator& operator=( const Simulator& ) = delete ;
+    
+    /*
+     Restarts from an empty state with new parameters (as if newly constructed),
+     keeping the memory of the tree tracker and of the list of infected lineages,
+     hence replicates run on warm memory.
+     */
+    void reset( double R0, double dI, double rho ) ;
     void initialise_single_infection() ;
     void set_max_cases( int max_cases ) ;
     void set_max_samples( int max_samples ) ;
+    void set_stats_interval( double stats_interval ) ; // records tracker state every 'stats_interval' time units (0: never)
+    void set_event_log( EventLogWriter<int>* event_log ) ; // records all events to 'event_log' (not owned; nullptr: stop recording)
     
     bool simulate() ;
     void apply_infection() ;
     void apply_removal( double prob_sampling ) ;
     
    
+    /*
+     Checkpoints: writes (resp. restores) the whole state of the simulation,
+     i.e. parameters, infected lineages, the tree tracker and the random number
+     generator, hence a restored simulation goes on exactly as the original one.
+     Both return 'false' if the file cannot be written (resp. is invalid).
+     */
+    bool save_checkpoint( const std::string& path ) const ;
+    bool load_checkpoint( const std::string& path ) ;
+    
     LineageTree<int,int>* get_tree() { return tree_mngr ; }
+    const TrackerSeries& get_stats_series() const { return stats_series ; }
 
 private:
    
@@ -44,6 +87,13 @@ private:
     int n_sampled ;
     int max_cases ;
     int max_samples ;
+    
+    EventLogWriter<int>* event_log ;
+    
+    double stats_interval ;
+    double next_stats_t ;
+    TrackerSeries stats_series ;
+    void record_stats() ;
 
     /*
      LineageTree<T,U> manages the transmission tree
@@ -0,0 +1,336 @@
+//
+//  text_sink.hpp
+//  BDmodel
+//
+
+#ifndef text_sink_hpp
+#define text_sink_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <unistd.h>
+#define TEXT_SINK_FD
+#endif
+
+#ifdef TREE_ZLIB // add -DTREE_ZLIB to the compiler flags and link with -lz
+#include <zlib.h>
+#endif
+
+
+//====== TextSink ======//
+
+/*
+
+ Destination of text written piece by piece, e.g. trees streamed by
+ 'writeSimpleNewick', 'writeNHX' and 'writeForest' (see 'tree.hpp').
+
+ 'write' never fails loudly: errors are remembered, and reported by
+ 'good' (and by 'flush' and 'close' in sinks that buffer), hence a
+ whole tree is written with a single check at the end.
+
+ */
+
+class TextSink {
+public:
+
+    virtual ~TextSink() {} ;
+
+    virtual void write( const char* data, std::size_t n ) = 0 ;
+    virtual bool good() const = 0 ;
+
+    /*
+     Hands data buffered by this sink (if any) to its destination.
+     */
+    virtual bool flush() { return good() ; }
+
+    void writeString( const std::string& s ) { write( s.data(), s.size() ) ; }
+
+} ;
+
+
+//====== StreamSink ======//
+
+/*
+
+ Writes to a 'std::ostream' (e.g. 'std::cout' or a 'std::ofstream'),
+ which does its own buffering.
+
+ */
+
+class StreamSink : public TextSink {
+public:
+
+    explicit StreamSink( std::ostream& out ): out( out ) {} ;
+
+    void write( const char* data, std::size_t n ) { out.write( data, n ) ; }
+    bool good() const { return out.good() ; }
+    bool flush() { out.flush() ; return out.good() ; }
+
+private:
+    std::ostream& out ;
+
+} ;
+
+
+//====== FileSink ======//
+
+/*
+
+ Buffered writer to a file, opened from its path ('open') or given as a
+ POSIX file descriptor ('fromDescriptor', e.g. 1 for the standard output,
+ or the write end of a pipe). Small writes are gathered in a buffer of
+ 'bufferSize' bytes, larger ones go straight to the file.
+
+ Data is complete once the sink is closed ('close' or destructor), which
+ also closes the file if this sink opened it. Elsewhere than on POSIX
+ systems, files are written through 'std::FILE'.
+
+ */
+
+class FileSink : public TextSink {
+public:
+
+    explicit FileSink( std::size_t bufferSize = 1 << 16 ): fd( -1 ), file( nullptr ), owned( false ), failed( false ), bufferSize( bufferSize ) {} ;
+
+#ifdef TEXT_SINK_FD
+    /*
+     Sink writing to the open file descriptor 'fd', which is not closed by the sink.
+     */
+    static FileSink fromDescriptor( int fd, std::size_t bufferSize = 1 << 16 ) { return FileSink( fd, bufferSize, false ) ; }
+#endif
+
+    FileSink( FileSink&& other ) noexcept : fd( other.fd ), file( other.file ), owned( other.owned ), failed( other.failed ), bufferSize( other.bufferSize ), buffer( std::move( other.buffer ) ) {
+
+        other.fd = -1 ;
+        other.file = nullptr ;
+        other.owned = false ;
+        other.buffer.clear() ;
+
+    }
+
+    ~FileSink() { close() ; }
+
+    FileSink( const FileSink& ) = delete ;
+    FileSink& operator=( const FileSink& ) = delete ;
+
+    /*
+     Creates (or truncates) the file at 'path'. Returns 'false' if it cannot be written.
+     */
+    bool open( const std::string& path ) {
+
+        close() ;
+        failed = false ;
+
+#ifdef TEXT_SINK_FD
+        fd = ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ;
+        failed = fd < 0 ;
+#else
+        file = std::fopen( path.c_str(), "wb" ) ;
+        failed = file == nullptr ;
+#endif
+        owned = !failed ;
+        return !failed ;
+
+    }
+
+    void write( const char* data, std::size_t n ) {
+
+        if ( failed )
+            return ;
+
+        if ( buffer.size() + n <= bufferSize ) {
+            if ( buffer.capacity() < bufferSize )
+                buffer.reserve( bufferSize ) ;
+            buffer.insert( buffer.end(), data, data + n ) ;
+            return ;
+        }
+
+        if ( flush() and n > 0 ) {
+            if ( n < bufferSize )
+                buffer.assign( data, data + n ) ;
+            else
+                send( data, n ) ;
+        }
+
+    }
+
+    bool good() const { return !failed ; }
+
+    bool flush() {
+
+        if ( !failed and !buffer.empty() )
+            send( buffer.data(), buffer.size() ) ;
+        buffer.clear() ;
+        return !failed ;
+
+    }
+
+    /*
+     Flushes, then closes the file if it was opened by 'open'. Returns 'false' if anything went wrong.
+     */
+    bool close() {
+
+        bool ok = flush() ;
+
+#ifdef TEXT_SINK_FD
+        if ( owned and fd >= 0 and ::close( fd ) != 0 )
+            ok = false ;
+#else
+        if ( owned and file != nullptr and std::fclose( file ) != 0 )
+            ok = false ;
+#endif
+        fd = -1 ;
+        file = nullptr ;
+        owned = false ;
+        return ok ;
+
+    }
+
+private:
+    FileSink( int fd, std::size_t bufferSize, bool owned ): fd( fd ), file( nullptr ), owned( owned ), failed( fd < 0 ), bufferSize( bufferSize ) {} ;
+
+    int fd ;
+    std::FILE* file ;
+    bool owned ; // true if opened (hence closed) here
+    bool failed ;
+    std::size_t bufferSize ;
+    std::vector<char> buffer ;
+
+    void send( const char* data, std::size_t n ) {
+
+#ifdef TEXT_SINK_FD
+        while ( n > 0 and !failed ) {
+            ssize_t written = ::write( fd, data, n ) ;
+            if ( written < 0 ) {
+                if ( errno != EINTR )
+                    failed = true ;
+            }
+            else { // partial writes (e.g. pipes)
+                data += written ;
+                n -= static_cast<std::size_t>( written ) ;
+            }
+        }
+#else
+        if ( file == nullptr or std::fwrite( data, 1, n, file ) != n )
+            failed = true ;
+#endif
+
+    }
+
+} ;
+
+
+//====== GzipSink ======//
+
+#ifdef TREE_ZLIB
+
+/*
+
+ Compresses text on the fly in gzip format (readable by 'gunzip', 'zcat'
+ or Python's 'gzip' module) and writes it to another sink, e.g.
+
+    FileSink file ;
+    file.open( "trees.nwk.gz" ) ;
+    GzipSink gz( file ) ;
+    writeForest( gz, rtrees ) ;
+    gz.close() ; // then file.close()
+
+ 'level' ranges from 1 (fastest) to 9 (smallest). Data is complete once
+ 'close' has been called (also by the destructor), which does not close
+ 'out'.
+
+ */
+
+class GzipSink : public TextSink {
+public:
+
+    explicit GzipSink( TextSink& out, int level = Z_DEFAULT_COMPRESSION, std::size_t bufferSize = 1 << 16 ): out( out ), finished( false ), buffer( bufferSize ) {
+
+        std::memset( &stream, 0, sizeof( stream ) ) ;
+        failed = deflateInit2( &stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ; // 15 + 16: gzip header
+        initialised = !failed ;
+
+    }
+
+    ~GzipSink() {
+
+        close() ;
+        if ( initialised )
+            deflateEnd( &stream ) ;
+
+    }
+
+    GzipSink( const GzipSink& ) = delete ;
+    GzipSink& operator=( const GzipSink& ) = delete ;
+
+    void write( const char* data, std::size_t n ) {
+
+        if ( failed or finished )
+            return ;
+
+        while ( n > 0 and !failed ) { // 'avail_in' is 32 bits
+            uInt chunk = static_cast<uInt>( std::min<std::size_t>( n, 1u << 30 ) ) ;
+            stream.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( data ) ) ;
+            stream.avail_in = chunk ;
+            deflateAll( Z_NO_FLUSH ) ;
+            data += chunk ;
+            n -= chunk ;
+        }
+
+    }
+
+    bool good() const { return !failed and out.good() ; }
+
+    /*
+     Ends the gzip stream (later writes are ignored). Returns 'false' if anything went wrong.
+     */
+    bool close() {
+
+        if ( !failed and !finished ) {
+            stream.next_in = nullptr ;
+            stream.avail_in = 0 ;
+            deflateAll( Z_FINISH ) ;
+        }
+        finished = true ;
+        return good() ;
+
+    }
+
+private:
+    TextSink& out ;
+    z_stream stream ;
+    bool initialised ;
+    bool failed ;
+    bool finished ;
+    std::vector<char> buffer ;
+
+    void deflateAll( int mode ) {
+
+        int status = Z_OK ;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>( buffer.data() ) ;
+            stream.avail_out = static_cast<uInt>( buffer.size() ) ;
+            status = deflate( &stream, mode ) ;
+            if ( status == Z_STREAM_ERROR ) {
+                failed = true ;
+                return ;
+            }
+            out.write( buffer.data(), buffer.size() - stream.avail_out ) ;
+        } while ( stream.avail_out == 0 or ( mode == Z_FINISH and status != Z_STREAM_END ) ) ;
+
+    }
+
+} ;
+
+#endif
+
+#endif /* text_sink_hpp */
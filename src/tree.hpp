@@ -9,6 +9,7 @@
 #define tree_h
 
 #include <cassert>
+#include <cstdint>
 #include <sstream>
 #include <ostream>
 #include <iostream>
@@ -16,7 +17,329 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <type_traits>
 #include <algorithm>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "flat_hash_map.hpp"
+#include "binary_io.hpp"
+#include "number_format.hpp"
+#include "text_sink.hpp"
+
+
+//====== Statistics ======//
+
+/*
+ 
+ Optional instrumentation of the tracking data structures.
+ 
+ Counters are only updated if 'TREE_STATS' is defined at compile time
+ (e.g. -DTREE_STATS). Otherwise 'TREE_STATS_UPDATE' expands to nothing
+ and instrumentation costs nothing; statistics then remain zero.
+ 
+ */
+
+#ifdef TREE_STATS
+#define TREE_STATS_UPDATE( statement ) statement
+#else
+#define TREE_STATS_UPDATE( statement )
+#endif
+
+/*
+ Statistics of a 'LineageTree' (see 'LineageTree::getStats').
+ */
+
+struct LineageTreeStats {
+    
+    bool enabled ; // true if compiled with TREE_STATS
+    uint64_t nodesAllocated ;
+    uint64_t nodesFreed ;
+    uint64_t merges ; // merge moves ('mergeParentChild')
+    uint64_t peakNodes ; // largest number of stored nodes
+    std::size_t bytesPerNode ; // memory footprint of a stored node (excluding heap-allocated children lists)
+    std::vector<uint64_t> cascadeDepths ; // [d]: number of removals whose notification travelled d nodes upstream
+    uint64_t compactions ; // bulk pruning sweeps (see 'LineageTree::compact')
+    uint64_t subSampleCalls ;
+    double subSampleSeconds ; // time spent in 'subSampleTree'
+    
+} ;
+
+/*
+ Statistics of 'getAncestralTree' (all trees and threads, see 'ancestralTreeStats').
+ */
+
+struct AncestralTreeStats {
+    
+    std::atomic<uint64_t> calls ;
+    std::atomic<uint64_t> nanoseconds ;
+    
+} ;
+
+inline AncestralTreeStats& ancestralTreeStats() {
+    
+    static AncestralTreeStats stats = { {0}, {0} } ;
+    return stats ;
+    
+}
+
+/*
+ Adds the time elapsed during its lifetime to 'nanoseconds'.
+ */
+
+class ScopedStatsTimer {
+public:
+    
+    explicit ScopedStatsTimer( std::atomic<uint64_t>& nanoseconds ): nanoseconds( nanoseconds ), start( std::chrono::steady_clock::now() ) {} ;
+    ~ScopedStatsTimer() { nanoseconds += static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() ) ; } ;
+    
+private:
+    std::atomic<uint64_t>& nanoseconds ;
+    std::chrono::steady_clock::time_point start ;
+    
+} ;
+
+
+//====== Tree traversal ======//
+
+/*
+ 
+ Depth-first traversal with an explicit stack, shared by the tree
+ algorithms of this file. No recursion is involved, hence very deep
+ trees (e.g. long transmission chains) can not overflow the call stack.
+ 
+ 'Node' is any node reference (pointer or handle) and 'Tree' tells how
+ to reach its children:
+ 
+    std::size_t nChildren( Node node ) const ;
+    Node child( Node node, std::size_t i ) const ;
+ 
+ 'Visitor' receives two events per node:
+ 
+    bool enter( Node node ) ; // before children (return 'false' to skip them)
+    void leave( Node node ) ; // after children (also called for skipped nodes)
+ 
+ Children are visited in order. 'nChildren' is queried right after
+ 'enter' (which may thus reorder children) and 'leave' is the last time
+ a node is touched, hence visitors may free nodes in 'leave'.
+ 
+ */
+
+template <typename Node, class Tree, class Visitor>
+void traverseDepthFirst( Node root, const Tree& tree, Visitor& visitor ) {
+    
+    struct Frame {
+        Node node ;
+        std::size_t next ; // next child to visit
+        std::size_t n ; // number of children
+    } ;
+    
+    if ( !visitor.enter( root ) ) {
+        visitor.leave( root ) ;
+        return ;
+    }
+    
+    std::vector<Frame> stack ;
+    stack.push_back( Frame{ root, 0, tree.nChildren( root ) } ) ;
+    
+    while ( !stack.empty() ) {
+        
+        Frame& frame = stack.back() ;
+        
+        if ( frame.next < frame.n ) { // go down
+            
+            Node child = tree.child( frame.node, frame.next++ ) ;
+            if ( visitor.enter( child ) )
+                stack.push_back( Frame{ child, 0, tree.nChildren( child ) } ) ; // invalidates 'frame'
+            else
+                visitor.leave( child ) ;
+            
+        }
+        else { // all children done: go up
+            
+            Node node = frame.node ;
+            stack.pop_back() ;
+            visitor.leave( node ) ;
+            
+        }
+        
+    }
+    
+}
+
+template <class F>
+struct PreOrderVisitor {
+    F& f ;
+    template <typename Node> bool enter( Node node ) { f( node ) ; return true ; }
+    template <typename Node> void leave( Node ) {}
+} ;
+
+template <class F>
+struct PostOrderVisitor {
+    F& f ;
+    template <typename Node> bool enter( Node ) { return true ; }
+    template <typename Node> void leave( Node node ) { f( node ) ; }
+} ;
+
+/*
+ Calls 'f( node )' on every node descending from 'root' (included), parents before children.
+ */
+
+template <typename Node, class Tree, class F>
+void visitPreOrder( Node root, const Tree& tree, F f ) {
+    
+    PreOrderVisitor<F> visitor{ f } ;
+    traverseDepthFirst( root, tree, visitor ) ;
+    
+}
+
+/*
+ Calls 'f( node )' on every node descending from 'root' (included), children before parents.
+ */
+
+template <typename Node, class Tree, class F>
+void visitPostOrder( Node root, const Tree& tree, F f ) {
+    
+    PostOrderVisitor<F> visitor{ f } ;
+    traverseDepthFirst( root, tree, visitor ) ;
+    
+}
+
+
+//====== Parallel loops ======//
+
+/*
+ 
+ Calls 'f( i )' for i = 0, ..., n - 1 on 'nthreads' threads (the calling
+ thread included). Indices are handed out one at a time from a shared
+ counter, hence threads done with short tasks take over the remaining
+ ones and uneven tasks are balanced. 'f' must be safe to call concurrently.
+ 
+ */
+
+template <class F>
+void parallelFor( std::size_t n, unsigned nthreads, F f ) {
+    
+    std::atomic<std::size_t> next( 0 ) ;
+    auto work = [&]() {
+        for ( std::size_t i = next++; i < n; i = next++ )
+            f( i ) ;
+    } ;
+    
+    std::vector<std::thread> threads ;
+    for ( std::size_t k = 1; k < std::min<std::size_t>( nthreads, n ); ++k )
+        threads.push_back( std::thread( work ) ) ;
+    
+    work() ;
+    for ( std::thread& th : threads )
+        th.join() ;
+    
+}
+
+
+//====== Locations ======//
+
+/*
+ 
+ Sampling locations are interned: nodes store a small 'LocationID' and
+ names are kept once in a 'LocationDictionary' (owned by 'LineageTree'),
+ to be resolved only when writing trees.
+ 
+ IDs are assigned in order of first appearance and never change.
+ 'LOCATION_NA' ("NA") is the location of unsampled nodes and
+ 'LOCATION_DEFAULT' ("@") the default location of sampled ones.
+ 
+ */
+
+typedef uint16_t LocationID ;
+const LocationID LOCATION_NA = 0 ;
+const LocationID LOCATION_DEFAULT = 1 ;
+
+class LocationDictionary {
+public:
+    
+    LocationDictionary() {
+        
+        intern( "NA" ) ;
+        intern( "@" ) ;
+        
+    } ;
+    
+    /*
+     Returns the ID of location 'name' (a new one if 'name' is new).
+     */
+    LocationID intern( const std::string& name ) {
+        
+        const LocationID* id = ids.find( name ) ;
+        if ( id != nullptr )
+            return *id ;
+        
+        assert( names.size() <= 0xFFFF ) ; // too many locations for 'LocationID'
+        LocationID newId = static_cast<LocationID>( names.size() ) ;
+        names.push_back( name ) ;
+        ids.insert( name, newId ) ;
+        return newId ;
+        
+    }
+    
+    const std::string& name( LocationID id ) const {
+        
+        assert( id < names.size() ) ;
+        return names[id] ;
+        
+    }
+    
+    std::size_t size() const { return names.size() ; }
+    
+private:
+    std::vector<std::string> names ; // indexed by ID
+    FlatHashMap<std::string, LocationID> ids ;
+    
+} ;
+
+
+//====== Sampling schemes ======//
+
+/*
+ 
+ A run may track several sampling schemes at once (e.g. surveillance
+ strategies with different sampling probabilities): each lineage is
+ sampled in a subset of schemes, nodes are kept as long as any scheme
+ needs them, and trees are extracted for any subset of schemes (see
+ 'LineageTree::subSampleTree( SchemeSet )').
+ 
+ Schemes are named and numbered by 'LineageTree::addSamplingScheme', up
+ to 'MAX_SCHEMES'. 'SCHEME_DEFAULT' ("@") is the scheme of lineages
+ sampled without a scheme.
+ 
+ */
+
+typedef uint8_t SchemeID ;
+const SchemeID SCHEME_DEFAULT = 0 ;
+const SchemeID MAX_SCHEMES = 32 ;
+
+class SchemeSet {
+public:
+    
+    SchemeSet(): mask( 0 ) {} ;
+    
+    static SchemeSet single( SchemeID id ) { assert( id < MAX_SCHEMES ) ; return SchemeSet( uint32_t( 1 ) << id ) ; }
+    static SchemeSet fromBits( uint32_t bits ) { return SchemeSet( bits ) ; }
+    
+    SchemeSet operator|( SchemeSet other ) const { return SchemeSet( mask | other.mask ) ; }
+    SchemeSet& operator|=( SchemeSet other ) { mask |= other.mask ; return *this ; }
+    
+    bool contains( SchemeID id ) const { return ( mask >> id ) & 1 ; }
+    bool intersects( SchemeSet other ) const { return ( mask & other.mask ) != 0 ; }
+    bool empty() const { return mask == 0 ; }
+    uint32_t bits() const { return mask ; }
+    
+private:
+    explicit SchemeSet( uint32_t mask ): mask( mask ) {} ;
+    uint32_t mask ;
+    
+} ;
 
 
 //====== LineageTreeNode ======//
@@ -24,14 +347,14 @@
 template <typename T, typename U, class Hash = std::hash<T>>
 struct LineageTreeNode {
     
-    LineageTreeNode( const T& lng, const U& data, const double& t, const bool& extant, LineageTreeNode<T,U>* parent = nullptr  ): t( t ), tSample( 0. ), tBranchParent( t ), locSample("NA"), lng( lng ), data( data ), extant( extant ), parent( parent ), needed( false ), sampled( false ) {
+    LineageTreeNode( const T& lng, const U& data, const double& t, const bool& extant, LineageTreeNode* parent = nullptr  ): t( t ), tSample( 0. ), tBranchParent( t ), locSample( LOCATION_NA ), lng( lng ), data( data ), extant( extant ), parent( parent ), needed( false ), sampled( false ) {
         
         children = {} ;
         //children_branching_times = {} ;
         
     }
     
-    void eraseChild( LineageTreeNode<T,U>* child ) { // removes child from children (does not perform further updates though)
+    void eraseChild( LineageTreeNode* child ) { // removes child from children (does not perform further updates though)
         
         auto it = children.begin() ;
         while( it != children.end() ) {
@@ -55,11 +378,11 @@ struct LineageTreeNode {
     double t ; // birth time
     double tSample ; // sampling time
     double tBranchParent ; // time at which lineage branched from parent node (not necessarily the true parent)
-    std::string locSample ; // sampling location
+    LocationID locSample ; // sampling location
     T lng ;
     U data ;
-    LineageTreeNode<T,U>* parent ;
-    std::vector<LineageTreeNode<T,U>*> children ;
+    LineageTreeNode* parent ;
+    std::vector<LineageTreeNode*> children ;
     bool extant ; // true if still around in simulation
     bool needed ; // true if required in reduced transmission tree
     bool sampled ; // true if sampled
@@ -69,332 +392,2404 @@ struct LineageTreeNode {
 } ;
 
 /*
- Frees memory allocated to a LineageTreeNode<T,U> tree.
+ Children accessor of LineageTreeNode<T,U> trees (see 'traverseDepthFirst').
  */
 
-template<typename T, typename U>
-void deleteLineageTreeNodeTree( LineageTreeNode<T,U>* root ) {
+struct LineageTreeNodeChildren {
     
-    while( not root->children.empty()  ) {
-        
-        deleteLineageTreeNodeTree( root->children.back() ) ;
-        root->children.pop_back() ;
-        
-    }
+    template <typename T, typename U, class Hash>
+    std::size_t nChildren( LineageTreeNode<T,U,Hash>* node ) const { return node->children.size() ; }
     
-    delete root ;
+    template <typename T, typename U, class Hash>
+    LineageTreeNode<T,U,Hash>* child( LineageTreeNode<T,U,Hash>* node, std::size_t i ) const { return node->children[i] ; }
     
-}
+} ;
+
+/*
+ Frees memory allocated to a LineageTreeNode<T,U> tree.
+ */
 
+template <typename T, typename U, class Hash>
+void deleteLineageTreeNodeTree( LineageTreeNode<T,U,Hash>* root ) {
+    
+    visitPostOrder( root, LineageTreeNodeChildren(), []( LineageTreeNode<T,U,Hash>* node ) { delete node ; } ) ;
 
-//====== LineageTree ======//
+}
+
+/*
+ 
+ Owner of reduced transmission trees (e.g. the result of 'subSampleTree'),
+ which are freed when it goes out of scope:
+ 
+    ReducedForest<int,int> rtrees( tree_mngr->subSampleTree() ) ;
+    PhyloTree<int,int> atree( getAncestralTree( rtrees[0] ) ) ;
+ 
+ Movable, not copyable. 'release' hands the trees back to the caller.
+ 
+ */
 
 template <typename T, typename U, class Hash = std::hash<T>>
-class LineageTree {
+class ReducedForest {
 public:
-    /*
-     
-     Constructor (creates an empty tree).
-     
-     */
-    LineageTree(): nnodes( 0 ) {
-        
-        extantLngs = {} ;
-        roots.clear() ;
-        sampled_lineages.clear() ;
-        //parent_info = {} ;
-        
-    } ;
     
+    typedef LineageTreeNode<T,U,Hash> Node ;
+    typedef typename std::vector<Node*>::const_iterator const_iterator ;
     
-    /*
-     Reset function.
-     
-     SHOULD BE USED WHEN THE SAME LINEAGE TREE INSTANCE
-     IS RE-USED ACROSS INDEPENDENT SIMULATIONS LAUNCHED
-     SEQUENTIALLY.
-     
-     */
-    void reset() {
-               
-        /*
-
-        auto extantLngsCopy = extantLngs ; // Use copy to avoid errors during lineage removal
+    ReducedForest() {} ;
+    explicit ReducedForest( std::vector<Node*> trees ): trees( std::move( trees ) ) {} ;
+    ReducedForest( ReducedForest&& other ) noexcept : trees( std::move( other.trees ) ) { other.trees.clear() ; } ;
+    ~ReducedForest() { clear() ; } ;
+    
+    ReducedForest( const ReducedForest& ) = delete ;
+    ReducedForest& operator=( const ReducedForest& ) = delete ;
+    
+    ReducedForest& operator=( ReducedForest&& other ) noexcept {
         
-        for ( auto leaves : extantLngsCopy ) {
-            
-            T lng = leaves.first ;
-            removeExtantLineage( lng, true ) ;
-            
+        if ( this != &other ) {
+            clear() ;
+            trees.swap( other.trees ) ;
         }
-
-        sampled_lineages.clear() ; */
+        return *this ;
         
-        for ( auto root : this->roots )
-            deleteLineageTreeNodeTree( root ) ;
+    }
+    
+    std::size_t size() const { return trees.size() ; }
+    bool empty() const { return trees.empty() ; }
+    Node* operator[]( std::size_t i ) const { return trees[i] ; }
+    const_iterator begin() const { return trees.begin() ; }
+    const_iterator end() const { return trees.end() ; }
+    
+    void clear() { // frees all trees
         
-        roots.clear() ;
-        extantLngs.clear() ;
-        sampled_lineages.clear() ;
-        //parent_info.clear() ;
+        for ( Node* root : trees )
+            deleteLineageTreeNodeTree( root ) ;
+        trees.clear() ;
         
-        nnodes = 0 ;
-      
-        // ??? persistent reminder to avoid memory leaks
-    } ;
+    }
     
-    /*
-     
-     Adds a lineage 'lng' born at time 't' with parent 'lngParent' with
-     metadata 'data'.
-     
-     THIS FUNCTION SHOULD BE CALLED AFTER A TRANSMISSION EVENT.
-     
-     */
-    void addExtantLineage( const double& t, const T& lng, const U& data, const T& lngParent )  {
+    std::vector<Node*> release() {
         
-        LineageTreeNode<T,U>* lngParentNode = extantLngs[lngParent] ;
-        LineageTreeNode<T,U>* lngNode = new LineageTreeNode<T,U>( lng, data, t, true, lngParentNode ) ;
-        lngParentNode->children.push_back( lngNode ) ;
-        //lngParentNode->children_branching_times[lng] = t ;
-        extantLngs[lng] = lngNode ;
-        ++nnodes ;
+        std::vector<Node*> res ;
+        res.swap( trees ) ;
+        return res ;
         
     }
     
-    /*
-     
-     Adds a lineage 'lng' born at time 't' with metadata 'data' and no parent.
-     
-     THIS FUNCTION SHOULD BE USED WHEN AN EXTERNAL INTRODUCTION OCCURS.
-     
-     */
-    void addExtantLineageExternal( const double& t, const T& lng, const U& data )  {
-                
-        LineageTreeNode<T,U>* lngNode = new LineageTreeNode<T,U>( lng, data, t, true, nullptr ) ;
-        extantLngs[lng] = lngNode ;
-        roots.insert( lngNode ) ;
-        ++nnodes ;
-        
-    } ;
+private:
+    std::vector<Node*> trees ;
     
-    /*
-     
-     Removes lineage 'lng' that became extinct.
-     
-     'lng' could be EXTREMAL (i.e. with no children) or INTERNAL within the tree.
-     
-     'lng' could be SAMPLED or UNSAMPLED.
-     
-     If 'lng' is NOT SAMPLED, do the following:
-     
-        Check if 'lng' is EXTREMAL or INTERNAL:
-     
-            a. if EXTREMAL, check if lng is ROOT
-                i.. if YES, remove 'lng' from the root list
+} ;
+
+
+//====== NodePool ======//
+
+/*
+
+ Nodes of the live transmission forest are stored contiguously in a
+ 'NodePool' and refer to each other through 32-bit handles (indices
+ into the pool) instead of raw pointers.
+
+ Released handles are recycled through a free list, hence allocating
+ and releasing a node are O(1) and do not call malloc/free once the
+ pool has grown to its working size. Clearing the pool drops all nodes
+ at once while retaining the allocated capacity.
+
+ Where node fields live in memory is up to the 'Store' (see 'Node
+ stores'): nodes are split in a 'hot' part (topology and flags) and a
+ 'cold' part (timing and metadata), accessed with 'hot( h )' and
+ 'cold( h )'.
+
+ N.B. references to pool nodes are invalidated by 'allocate' (the
+ underlying vectors may grow), handles are not.
+
+ */
+
+typedef uint32_t NodeHandle ;
+const NodeHandle NULL_NODE = 0xFFFFFFFF ; // plays the role of 'nullptr' for handles
+
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define NODE_PREFETCH( addr ) __builtin_prefetch( addr )
+#else
+#define NODE_PREFETCH( addr )
+#endif
+
+template <class Store>
+class NodePool {
+public:
+
+    typedef typename Store::Hot Hot ;
+    typedef typename Store::Cold Cold ;
+
+    NodePool(): nlive( 0 ) {} ;
+
+    NodeHandle allocate() {
+
+        ++nlive ;
+
+        if ( !freeHandles.empty() ) { // recycle a released slot
+
+            NodeHandle h = freeHandles.back() ;
+            freeHandles.pop_back() ;
+            return h ;
+
+        }
+
+        assert( nodes.size() < NULL_NODE ) ;
+        nodes.grow() ;
+        return static_cast<NodeHandle>( nodes.size() - 1 ) ;
+
+    }
+
+    void release( NodeHandle h ) {
+
+        assert( h < nodes.size() ) ;
+        freeHandles.push_back( h ) ;
+        --nlive ;
+
+    }
+
+    void clear() {
+
+        nodes.clear() ;
+        freeHandles.clear() ;
+        nlive = 0 ;
+
+    }
+
+    void reserve( std::size_t n ) { nodes.reserve( n ) ; }
+
+    /*
+     Restores the state of a pool (see 'LineageTree::load'): 'nhandles'
+     handles of which 'free' are released. Nodes in use must then be
+     re-initialised by the caller.
+     */
+    void restore( std::size_t nhandles, const std::vector<NodeHandle>& free ) {
+
+        assert( nhandles < NULL_NODE and free.size() <= nhandles ) ;
+
+        clear() ;
+        nodes.reserve( nhandles ) ;
+        for ( std::size_t i = 0; i < nhandles; ++i )
+            nodes.grow() ;
+        freeHandles = free ;
+        nlive = nhandles - free.size() ;
+
+    }
+
+    const std::vector<NodeHandle>& getFreeHandles() const { return freeHandles ; }
+
+    /*
+     Makes room for 'n' further allocations (recycled slots first).
+     Grows geometrically, hence may be called before every batch.
+     */
+    void reserveExtra( std::size_t n ) {
+
+        if ( n <= freeHandles.size() )
+            return ;
+
+        std::size_t needed = nodes.size() + n - freeHandles.size() ;
+        if ( needed > nodes.capacity() )
+            nodes.reserve( std::max( needed, 2 * nodes.capacity() ) ) ;
+
+    }
+
+    Hot& hot( NodeHandle h ) { return nodes.hot( h ) ; }
+    const Hot& hot( NodeHandle h ) const { return nodes.hot( h ) ; }
+    Cold& cold( NodeHandle h ) { return nodes.cold( h ) ; }
+    const Cold& cold( NodeHandle h ) const { return nodes.cold( h ) ; }
+
+    void prefetch( NodeHandle h ) const { NODE_PREFETCH( &nodes.hot( h ) ) ; } // hint: 'h' is accessed soon
+
+    std::size_t size() const { return nlive ; } // number of nodes in use
+    std::size_t endHandle() const { return nodes.size() ; } // all handles (in use or free) are smaller
+
+private:
+    Store nodes ;
+    std::vector<NodeHandle> freeHandles ;
+    std::size_t nlive ;
+
+} ;
+
+
+//====== ChildList ======//
+
+/*
+
+ Small-vector of child handles.
+
+ Up to 'INLINE' children are stored inside the node itself (most nodes
+ of the pruned forest have 0-2 children); larger lists move to the heap.
+ 'clear' keeps heap storage, so recycled nodes do not allocate again.
+
+ */
+
+class ChildList {
+public:
+
+    static const uint32_t INLINE = 2 ;
+
+    ChildList(): n( 0 ), cap( INLINE ) { storage.heap = nullptr ; } ;
+
+    ChildList( const ChildList& other ): n( 0 ), cap( INLINE ) { storage.heap = nullptr ; *this = other ; } ;
+
+    ChildList( ChildList&& other ) noexcept : n( 0 ), cap( INLINE ) { storage.heap = nullptr ; swap( other ) ; } ;
+
+    ~ChildList() { if ( onHeap() ) delete[] storage.heap ; } ;
+
+    ChildList& operator=( const ChildList& other ) {
+
+        if ( this != &other ) {
+            clear() ;
+            reserve( other.n ) ;
+            std::copy( other.begin(), other.end(), data() ) ;
+            n = other.n ;
+        }
+        return *this ;
+
+    }
+
+    ChildList& operator=( ChildList&& other ) noexcept {
+
+        swap( other ) ;
+        return *this ;
+
+    }
+
+    void swap( ChildList& other ) noexcept {
+
+        std::swap( n, other.n ) ;
+        std::swap( cap, other.cap ) ;
+        std::swap( storage, other.storage ) ; // swaps either the inline handles or the heap pointer (trivially copyable)
+
+    }
+
+    uint32_t size() const { return n ; }
+    bool empty() const { return n == 0 ; }
+
+    NodeHandle* data() { return onHeap() ? storage.heap : storage.inlined ; }
+    const NodeHandle* data() const { return onHeap() ? storage.heap : storage.inlined ; }
+    NodeHandle* begin() { return data() ; }
+    NodeHandle* end() { return data() + n ; }
+    const NodeHandle* begin() const { return data() ; }
+    const NodeHandle* end() const { return data() + n ; }
+
+    NodeHandle& operator[]( uint32_t i ) { return data()[i] ; }
+    const NodeHandle& operator[]( uint32_t i ) const { return data()[i] ; }
+    NodeHandle& back() { return data()[n-1] ; }
+
+    void push_back( NodeHandle h ) {
+
+        if ( n == cap )
+            reserve( 2 * cap ) ;
+        data()[n++] = h ;
+
+    }
+
+    void pop_back() { --n ; }
+    void clear() { n = 0 ; }
+
+    void reserve( uint32_t newCap ) {
+
+        if ( newCap <= cap )
+            return ;
+
+        NodeHandle* newHeap = new NodeHandle[newCap] ;
+        std::copy( begin(), end(), newHeap ) ;
+        if ( onHeap() )
+            delete[] storage.heap ;
+        storage.heap = newHeap ;
+        cap = newCap ;
+
+    }
+
+private:
+    bool onHeap() const { return cap > INLINE ; }
+
+    uint32_t n ;
+    uint32_t cap ;
+    union Storage {
+        NodeHandle inlined[INLINE] ;
+        NodeHandle* heap ;
+    } storage ;
+
+} ;
+
+
+//====== LineageTrackingNode ======//
+
+/*
+
+ Node of the live transmission forest managed by 'LineageTree'.
+
+ Same information as 'LineageTreeNode', except that nodes are owned by
+ the 'NodePool' of the tree and parent/children are node handles.
+ Nodes are recycled, hence 'LineageTree' re-initialises both parts after
+ 'allocate'.
+
+ Fields are split by access pattern:
+    - 'LineageTrackingHot': topology and flags, touched at every step of
+      the pruning walk (removals, merges, sampling).
+    - 'LineageTrackingCold': timing and metadata, only read when sampling
+      or extracting trees.
+
+ Each node stores its position ('slot') in the children list of its
+ parent, which lets 'LineageTree' detach or replace a child in O(1).
+
+ 'hasSampled' flags nodes with a SAMPLED node in their subtree (themselves
+ included), so that tree extraction can skip unsampled subtrees. Sampled
+ nodes are never pruned, hence flags are never cleared and the ancestors
+ of a flagged node are flagged too: sampling stops at the first one.
+ 'version' is the last snapshot epoch in which the reduced tree below the
+ node may have changed (see 'Snapshots' and 'invalidateSnapshots').
+
+ */
+
+struct LineageTrackingHot {
+
+    double tBranchParent ; // time at which lineage branched from parent node (not necessarily the true parent)
+    NodeHandle parent ;
+    uint32_t slot ; // position in parent->children
+    ChildList children ;
+    uint32_t version ; // snapshot epoch of the last sampling or removal of a sampled node of the subtree
+    bool extant : 1 ; // true if still around in simulation
+    bool sampled : 1 ; // true if sampled
+    bool hasSampled : 1 ; // true if a node of the subtree (including this one) is sampled
+    bool released : 1 ; // true once freed (until recycled)
+
+} ;
+
+template <typename T, typename U>
+struct LineageTrackingCold {
+
+    double t ; // birth time
+    double tSample ; // sampling time
+    T lng ;
+    U data ;
+    LocationID locSample ; // sampling location
+    uint32_t schemes ; // sampling schemes (see 'SchemeSet')
+
+} ;
+
+
+//====== Node stores ======//
+
+/*
+
+ Memory layouts of the hot and cold parts of pool nodes (see 'NodePool'):
+
+    - 'AoSLayout' (array of structures): both parts of a node are stored
+      next to each other in a single array.
+    - 'SoALayout' (structure of arrays): hot parts and cold parts are
+      stored in two separate arrays, hence walking the tree only brings
+      topology into cache, several nodes per cache line.
+
+ Both expose the same interface ('grow' appends a node).
+
+ */
+
+struct AoSLayout {} ;
+struct SoALayout {} ;
+
+template <class HotPart, class ColdPart, class Layout>
+class NodeStore ;
+
+template <class HotPart, class ColdPart>
+class NodeStore<HotPart, ColdPart, AoSLayout> {
+public:
+
+    typedef HotPart Hot ;
+    typedef ColdPart Cold ;
+
+    void grow() { nodes.push_back( Node() ) ; }
+    std::size_t size() const { return nodes.size() ; }
+    std::size_t capacity() const { return nodes.capacity() ; }
+    void reserve( std::size_t n ) { nodes.reserve( n ) ; }
+    void clear() { nodes.clear() ; }
+
+    Hot& hot( NodeHandle h ) { return nodes[h].hot ; }
+    const Hot& hot( NodeHandle h ) const { return nodes[h].hot ; }
+    Cold& cold( NodeHandle h ) { return nodes[h].cold ; }
+    const Cold& cold( NodeHandle h ) const { return nodes[h].cold ; }
+
+private:
+    struct Node {
+        Hot hot ;
+        Cold cold ;
+    } ;
+    std::vector<Node> nodes ;
+
+} ;
+
+template <class HotPart, class ColdPart>
+class NodeStore<HotPart, ColdPart, SoALayout> {
+public:
+
+    typedef HotPart Hot ;
+    typedef ColdPart Cold ;
+
+    void grow() {
+
+        hots.push_back( Hot() ) ;
+        colds.push_back( Cold() ) ;
+
+    }
+
+    std::size_t size() const { return hots.size() ; }
+    std::size_t capacity() const { return std::min( hots.capacity(), colds.capacity() ) ; }
+
+    void reserve( std::size_t n ) {
+
+        hots.reserve( n ) ;
+        colds.reserve( n ) ;
+
+    }
+
+    void clear() {
+
+        hots.clear() ;
+        colds.clear() ;
+
+    }
+
+    Hot& hot( NodeHandle h ) { return hots[h] ; }
+    const Hot& hot( NodeHandle h ) const { return hots[h] ; }
+    Cold& cold( NodeHandle h ) { return colds[h] ; }
+    const Cold& cold( NodeHandle h ) const { return colds[h] ; }
+
+private:
+    std::vector<Hot> hots ;
+    std::vector<Cold> colds ;
+
+} ;
+
+
+//====== Lineage indices ======//
+
+/*
+
+ A lineage index maps identifiers of EXTANT lineages to their node in the
+ live forest and records which lineages have been SAMPLED.
+
+ 'LineageTree' accepts any class exposing the following interface:
+
+    NodeHandle find( const T& lng ) const ; // NULL_NODE if 'lng' is not extant
+    void insert( const T& lng, NodeHandle node ) ;
+    void erase( const T& lng ) ;
+    NodeHandle take( const T& lng ) ; // erases 'lng' and returns its node (NULL_NODE if not extant)
+    std::size_t size() const ; // number of extant lineages
+    void markSampled( const T& lng ) ;
+    bool isSampled( const T& lng ) const ;
+    void reserve( std::size_t n ) ;
+    void clear() ;
+
+ By default, integral identifiers use 'DenseLineageIndex' and any other
+ type uses 'HashLineageIndex' (see 'DefaultLineageIndex').
+
+ */
+
+/*
+
+ Hash-based index, suitable for any identifier type. Requires 'Hash'
+ and 'operator==' for 'T' (and a default constructor, see 'FlatHashMap').
+
+ */
+
+template <typename T, class Hash = std::hash<T>>
+class HashLineageIndex {
+public:
+
+    NodeHandle find( const T& lng ) const {
+
+        const NodeHandle* node = extant.find( lng ) ;
+        return ( node != nullptr ) ? *node : NULL_NODE ;
+
+    }
+
+    void insert( const T& lng, NodeHandle node ) { extant[lng] = node ; }
+    void erase( const T& lng ) { extant.erase( lng ) ; }
+
+    NodeHandle take( const T& lng ) {
+
+        NodeHandle node = NULL_NODE ;
+        extant.take( lng, node ) ;
+        return node ;
+
+    }
+
+    std::size_t size() const { return extant.size() ; }
+
+    void markSampled( const T& lng ) { sampled.insert( lng ) ; }
+    bool isSampled( const T& lng ) const { return sampled.contains( lng ) ; }
+
+    void reserve( std::size_t n ) { extant.reserve( n ) ; }
+
+    void clear() {
+
+        extant.clear() ;
+        sampled.clear() ;
+
+    }
+
+private:
+    FlatHashMap<T, NodeHandle, Hash> extant ;
+    FlatHashSet<T, Hash> sampled ;
+
+} ;
+
+/*
+
+ Converts a lineage identifier into a position of 'DenseLineageIndex'.
+ May be specialised to use the dense index with non-integral identifiers.
+
+ */
+
+template <typename T>
+struct DenseIndexOf {
+
+    std::size_t operator()( const T& lng ) const {
+
+        assert( lng >= 0 ) ; // dense indices require non-negative identifiers
+        return static_cast<std::size_t>( lng ) ;
+
+    }
+
+} ;
+
+/*
+
+ Direct-indexed index for identifiers that are small non-negative
+ integers (e.g. handed out by a counter, as in 'Simulator').
+
+ Lookups are plain array accesses; memory grows linearly with the
+ largest identifier seen (4 bytes + 1 bit per identifier), hence use
+ 'HashLineageIndex' for sparse integral identifiers.
+
+ */
+
+template <typename T, class IndexOf = DenseIndexOf<T>>
+class DenseLineageIndex {
+public:
+
+    DenseLineageIndex(): nextant( 0 ) {} ;
+
+    NodeHandle find( const T& lng ) const {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        return ( ix < extant.size() ) ? extant[ix] : NULL_NODE ;
+
+    }
+
+    void insert( const T& lng, NodeHandle node ) {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        if ( ix >= extant.size() )
+            extant.resize( ix + 1, NULL_NODE ) ;
+
+        if ( extant[ix] == NULL_NODE )
+            ++nextant ;
+        extant[ix] = node ;
+
+    }
+
+    void erase( const T& lng ) {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        if ( ix < extant.size() and extant[ix] != NULL_NODE ) {
+            extant[ix] = NULL_NODE ;
+            --nextant ;
+        }
+
+    }
+
+    NodeHandle take( const T& lng ) {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        if ( ix >= extant.size() or extant[ix] == NULL_NODE )
+            return NULL_NODE ;
+
+        NodeHandle node = extant[ix] ;
+        extant[ix] = NULL_NODE ;
+        --nextant ;
+        return node ;
+
+    }
+
+    std::size_t size() const { return nextant ; }
+
+    void markSampled( const T& lng ) {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        if ( ix >= sampled.size() )
+            sampled.resize( ix + 1, false ) ;
+        sampled[ix] = true ;
+
+    }
+
+    bool isSampled( const T& lng ) const {
+
+        std::size_t ix = IndexOf()( lng ) ;
+        return ix < sampled.size() and sampled[ix] ;
+
+    }
+
+    void reserve( std::size_t n ) { extant.reserve( n ) ; }
+
+    void clear() { // keeps capacity
+
+        extant.clear() ;
+        sampled.clear() ;
+        nextant = 0 ;
+
+    }
+
+private:
+    std::vector<NodeHandle> extant ; // NULL_NODE if not extant
+    std::vector<bool> sampled ;
+    std::size_t nextant ;
+
+} ;
+
+template <typename T, class Hash>
+struct DefaultLineageIndex {
+
+    typedef typename std::conditional< std::is_integral<T>::value, DenseLineageIndex<T>, HashLineageIndex<T,Hash> >::type type ;
+
+} ;
+
+
+//====== Chain table ======//
+
+/*
+
+ Roots of the transmission forest, i.e. one per transmission chain, in
+ order of introduction (hence trees are listed in the same order in every
+ run, and after a checkpoint is restored).
+
+ Each entry flags whether its chain has sampled lineages, hence chains
+ without samples are skipped without touching their nodes. Roots store their
+ position in the table in their 'slot' (unused for roots), hence a root is
+ replaced or removed in O(1). Removed chains leave holes, squeezed out (in
+ order) once they outnumber live chains.
+
+ */
+
+class ChainTable {
+public:
+
+    struct Chain {
+        NodeHandle root ; // NULL_NODE once the chain is removed
+        bool sampled ; // true if the chain has sampled lineages
+    } ;
+
+    ChainTable(): nlive( 0 ), nsampled( 0 ) {} ;
+
+    void clear() { entries.clear() ; nlive = 0 ; nsampled = 0 ; }
+
+    /*
+     Adds a chain with root 'root' (with sampled lineages if 'sampled' is
+     'true') and returns its slot.
+     */
+    uint32_t add( NodeHandle root, bool sampled = false ) {
+
+        assert( entries.size() < 0xFFFFFFFF ) ;
+        entries.push_back( Chain{ root, sampled } ) ;
+        ++nlive ;
+        if ( sampled )
+            ++nsampled ;
+        return static_cast<uint32_t>( entries.size() - 1 ) ;
+
+    }
+
+    void replace( uint32_t slot, NodeHandle root ) { entries[slot].root = root ; }
+
+    void remove( uint32_t slot ) {
+
+        assert( !entries[slot].sampled ) ; // chains with samples are never removed
+        entries[slot].root = NULL_NODE ;
+        --nlive ;
+
+    }
+
+    void markSampled( uint32_t slot ) {
+
+        if ( !entries[slot].sampled ) {
+            entries[slot].sampled = true ;
+            ++nsampled ;
+        }
+
+    }
+
+    /*
+     Whether holes outnumber live chains ('squeeze' is then due).
+     */
+    bool sparse() const { return entries.size() > 1024 and entries.size() > 2 * nlive ; }
+
+    /*
+     Removes holes, keeping the order of chains; calls 'moved( root, slot )'
+     for each chain, with its new slot.
+     */
+    template <class Moved>
+    void squeeze( Moved moved ) {
+
+        std::size_t n = 0 ;
+        for ( const Chain& chain : entries ) {
+            if ( chain.root == NULL_NODE )
+                continue ;
+            moved( chain.root, static_cast<uint32_t>( n ) ) ;
+            entries[n++] = chain ;
+        }
+        entries.resize( n ) ;
+
+    }
+
+    std::size_t size() const { return nlive ; } // live chains
+    std::size_t sizeSampled() const { return nsampled ; } // chains with samples
+
+    // all entries, holes included (which have no samples)
+    std::vector<Chain>::const_iterator begin() const { return entries.begin() ; }
+    std::vector<Chain>::const_iterator end() const { return entries.end() ; }
+
+private:
+    std::vector<Chain> entries ; // by slot
+    std::size_t nlive ;
+    std::size_t nsampled ;
+
+} ;
+
+
+//====== Snapshots ======//
+
+/*
+ 
+ Immutable node of a reduced transmission tree held by a snapshot.
+ 
+ Same information as 'LineageTreeNode', except that the branching time
+ of a child ('tBranchParent') is stored on the edge from its parent:
+ nodes are shared between snapshots (and between trees of successive
+ snapshots), hence they must not depend on where they are attached.
+ 
+ */
+
+template <typename T, typename U>
+struct SnapshotNode {
+    
+    struct Edge {
+        double tBranchParent ;
+        std::shared_ptr<const SnapshotNode> node ;
+    } ;
+    
+    double t ;
+    double tSample ;
+    LocationID locSample ;
+    T lng ;
+    U data ;
+    bool extant ;
+    bool sampled ;
+    std::vector<Edge> children ;
+    
+} ;
+
+/*
+ 
+ Read-only view of the reduced transmission forest at the time it was
+ taken (see 'LineageTree::takeSnapshot').
+ 
+ A snapshot only holds shared pointers to immutable nodes, hence it stays
+ valid (and unchanged) while the live tree keeps being updated, and it
+ can be used from another thread. Subtrees that did not change between
+ two snapshots are shared rather than copied.
+ 
+ */
+
+template <typename T, typename U, class Hash = std::hash<T>>
+class LineageTreeSnapshot {
+public:
+    
+    typedef SnapshotNode<T,U> Node ;
+    
+    LineageTreeSnapshot(): t( 0. ) {} ;
+    LineageTreeSnapshot( const double& t, std::vector<std::shared_ptr<const Node>> roots, const LocationDictionary& locations ): t( t ), roots( std::move( roots ) ), locations( locations ) {} ;
+    
+    /*
+     Time at which the snapshot was taken (as passed to 'takeSnapshot').
+     */
+    double getTime() const { return t ; }
+    
+    /*
+     Number of reduced transmission trees (one per root with sampled lineages).
+     */
+    std::size_t size() const { return roots.size() ; }
+    
+    const std::vector<std::shared_ptr<const Node>>& getRoots() const { return roots ; }
+    
+    /*
+     Sampling locations known when the snapshot was taken (a copy, hence safe to use on another thread).
+     */
+    const LocationDictionary& getLocations() const { return locations ; }
+    
+    /*
+     
+     Yields the reduced transmission trees, in the same form (and order)
+     as 'LineageTree::subSampleTree' would have at the time of the snapshot.
+     
+     The trees are new copies owned by the caller (see 'deleteLineageTreeNodeTree').
+     
+     */
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree() const {
+        
+        std::vector<LineageTreeNode<T,U,Hash>*> res = {} ;
+        for ( const std::shared_ptr<const Node>& root : roots )
+            res.push_back( materialize( root.get() ) ) ;
+        
+        return res ;
+        
+    }
+    
+private:
+    double t ;
+    std::vector<std::shared_ptr<const Node>> roots ;
+    LocationDictionary locations ;
+    
+    struct Children {
+        std::size_t nChildren( const Node* node ) const { return node->children.size() ; }
+        const Node* child( const Node* node, std::size_t i ) const { return node->children[i].node.get() ; }
+    } ;
+    
+    static LineageTreeNode<T,U,Hash>* materialize( const Node* root ) {
+        
+        struct Copier {
+            
+            std::vector<std::pair<const Node*, LineageTreeNode<T,U,Hash>*>> copies ; // copies of the current path
+            LineageTreeNode<T,U,Hash>* result ;
+            
+            bool enter( const Node* node ) {
+                
+                LineageTreeNode<T,U,Hash>* parent = copies.empty() ? nullptr : copies.back().second ;
+                LineageTreeNode<T,U,Hash>* newNode = new LineageTreeNode<T,U,Hash>( node->lng, node->data, node->t, node->extant, parent ) ;
+                newNode->sampled   = node->sampled ;
+                newNode->tSample   = node->tSample ;
+                newNode->locSample = node->locSample ;
+                
+                if ( parent == nullptr ) {
+                    newNode->tBranchParent = node->t ; // irrelevant for roots
+                    result = newNode ;
+                }
+                else {
+                    const Node* nodeParent = copies.back().first ;
+                    newNode->tBranchParent = nodeParent->children[ parent->children.size() ].tBranchParent ; // children are visited in order
+                    parent->children.push_back( newNode ) ;
+                }
+                
+                copies.push_back( std::make_pair( node, newNode ) ) ;
+                return true ;
+                
+            }
+            
+            void leave( const Node* ) { copies.pop_back() ; }
+            
+        } copier{ {}, nullptr } ;
+        
+        traverseDepthFirst( root, Children(), copier ) ;
+        return copier.result ;
+        
+    }
+    
+} ;
+
+
+//====== Batched events ======//
+
+/*
+
+ Events of a block, for the batched updates of 'LineageTree'
+ ('addExtantLineages', 'sampleExtantLineages' and 'removeExtantLineages';
+ removals are plain lineage identifiers).
+
+ */
+
+template <typename T, typename U>
+struct BirthEvent {
+
+    BirthEvent( const double& t = 0., const T& lng = T(), const T& lngParent = T(), const U& data = U() ): t( t ), lng( lng ), lngParent( lngParent ), data( data ) {} ;
+
+    double t ;
+    T lng ;
+    T lngParent ;
+    U data ;
+
+} ;
+
+template <typename T>
+struct SamplingEvent {
+
+    SamplingEvent( const T& lng = T(), const double& t = 0., LocationID locSample = LOCATION_DEFAULT, SchemeSet schemes = SchemeSet::single( SCHEME_DEFAULT ) ): lng( lng ), t( t ), locSample( locSample ), schemes( schemes ) {} ;
+
+    T lng ;
+    double t ;
+    LocationID locSample ;
+    SchemeSet schemes ;
+
+} ;
+
+
+//====== Sampling windows ======//
+
+/*
+
+ Closed interval [t0,t1] of sampling times, e.g. to build the trees of the
+ lineages sampled in a given week ('LineageTree::subSampleTree( window )').
+
+ */
+
+struct SamplingWindow {
+
+    SamplingWindow( double t0, double t1 ): t0( t0 ), t1( t1 ) {} ;
+
+    bool contains( double t ) const { return t0 <= t and t <= t1 ; }
+
+    double t0 ;
+    double t1 ;
+
+} ;
+
+
+//====== LineageTree ======//
+
+/*
+ 
+ 'Index' maps lineage identifiers to nodes (see 'Lineage indices').
+ 'Layout' sets how nodes are laid out in memory (see 'Node stores').
+ 
+ */
+
+template <typename T, typename U, class Hash = std::hash<T>, class Index = typename DefaultLineageIndex<T,Hash>::type, class Layout = AoSLayout>
+class LineageTree {
+    
+    typedef NodePool<NodeStore<LineageTrackingHot, LineageTrackingCold<T,U>, Layout>> Pool ;
+    typedef LineageTrackingHot Hot ;
+    typedef LineageTrackingCold<T,U> Cold ;
+    
+public:
+    /*
+     
+     Constructor (creates an empty tree).
+     
+     */
+    LineageTree(): nnodes( 0 ), lazyPruning( false ), lazyMaxNodes( 0 ), compactAt( 0 ), samplesSorted( true ), snapshotEpoch( 0 ) {
+        
+        extantLngs.clear() ;
+        roots.clear() ;
+        schemeNames.push_back( "@" ) ; // SCHEME_DEFAULT
+        resetStats() ;
+        //parent_info = {} ;
+        
+    } ;
+    
+    
+    /*
+     Reset function.
+     
+     SHOULD BE USED WHEN THE SAME LINEAGE TREE INSTANCE
+     IS RE-USED ACROSS INDEPENDENT SIMULATIONS LAUNCHED
+     SEQUENTIALLY.
+     
+     */
+    void reset() {
+               
+        /*
+
+        auto extantLngsCopy = extantLngs ; // Use copy to avoid errors during lineage removal
+        
+        for ( auto leaves : extantLngsCopy ) {
+            
+            T lng = leaves.first ;
+            removeExtantLineage( lng, true ) ;
+            
+        }
+
+        sampled_lineages.clear() ; */
+        
+        nodes.clear() ; // releases all nodes at once
+        snapshotCache.clear() ;
+        snapshotEpoch = 0 ;
+        deferred.clear() ;
+        samplesByTime.clear() ;
+        samplesSorted = true ;
+        roots.clear() ;
+        extantLngs.clear() ; // also clears sampled lineages
+        //parent_info.clear() ;
+        
+        nnodes = 0 ;
+        compactAt = lazyMaxNodes ;
+        resetStats() ;
+      
+        // ??? persistent reminder to avoid memory leaks
+    } ;
+    
+    /*
+     
+     Pre-allocates room for 'n' simultaneously stored lineages.
+     
+     Optional: only avoids re-growing internal tables during the
+     early phase of a simulation.
+     
+     */
+    void reserve( std::size_t n ) {
+        
+        nodes.reserve( n ) ;
+        extantLngs.reserve( n ) ;
+        
+    }
+    
+    /*
+     
+     Pruning mode (eager by default).
+     
+     EAGER: every removal prunes the tree right away, i.e. the removed
+     lineage and the ancestors it made redundant are freed or merged at once
+     (see 'notifyParent'). In supercritical epidemics, successive removals
+     climb through the same ancestors again and again.
+     
+     LAZY ('lazy' = true): removals only mark nodes as extinct, and redundant
+     nodes are pruned by bulk sweeps ('compact'), which visit every node once.
+     Sweeps run when the number of nodes reaches 'maxNodes' (then twice the
+     number of nodes left by the previous sweep, if larger), or only when
+     'compact' is called if 'maxNodes' is 0. Switching back to eager pruning
+     runs a sweep.
+     
+     Reduced trees and snapshots do not depend on the mode (redundant nodes
+     are skipped during extraction anyway), except for the order in which
+     children are listed. The mode persists across 'reset'.
+     
+     */
+    void setLazyPruning( bool lazy, std::size_t maxNodes = 0 ) {
+        
+        if ( lazyPruning and !lazy )
+            compact() ;
+        
+        lazyPruning = lazy ;
+        lazyMaxNodes = lazy ? maxNodes : 0 ;
+        compactAt = std::max( lazyMaxNodes, 2 * static_cast<std::size_t>( nnodes ) ) ;
+        
+    }
+    
+    bool isLazyPruning() const { return lazyPruning ; }
+    
+    /*
+     
+     Prunes all redundant nodes, i.e. extinct unsampled nodes with no
+     children (freed) or a single child (merged with it), in a single pass
+     over the lineages removed since the previous sweep. Each of them is
+     pruned as an eager removal would have, including the ancestors it
+     makes redundant, hence every node is visited once.
+     
+     */
+    void compact() {
+        
+        TREE_STATS_UPDATE( ++stats.compactions ; )
+        
+        const std::size_t distance = 8 ; // nodes ahead (see 'prefetchBatch')
+        for ( std::size_t i = 0; i < deferred.size(); ++i ) {
+            
+            if ( i + distance < deferred.size() )
+                nodes.prefetch( deferred[i + distance] ) ;
+            
+            const Hot& node = nodes.hot( deferred[i] ) ;
+            if ( !node.released and !node.extant and !node.sampled ) // else pruned along with a descendant (or recycled)
+                pruneNode( deferred[i] ) ;
+            
+        }
+        deferred.clear() ;
+        
+        compactAt = std::max( lazyMaxNodes, 2 * static_cast<std::size_t>( nnodes ) ) ;
+        
+    }
+    
+    /*
+     
+     Adds a lineage 'lng' born at time 't' with parent 'lngParent' with
+     metadata 'data'.
+     
+     THIS FUNCTION SHOULD BE CALLED AFTER A TRANSMISSION EVENT.
+     
+     */
+    void addExtantLineage( const double& t, const T& lng, const U& data, const T& lngParent )  {
+        
+        NodeHandle lngParentNode = extantLngs.find( lngParent ) ;
+        assert( lngParentNode != NULL_NODE ) ; // parent must be extant
+        addChildNode( t, lng, data, lngParentNode ) ;
+        
+    }
+    
+    /*
+     
+     Adds a lineage 'lng' born at time 't' with metadata 'data' and no parent.
+     
+     THIS FUNCTION SHOULD BE USED WHEN AN EXTERNAL INTRODUCTION OCCURS.
+     
+     */
+    void addExtantLineageExternal( const double& t, const T& lng, const U& data )  {
+                
+        NodeHandle lngNode = nodes.allocate() ;
+        initNode( lngNode, lng, data, t, true, NULL_NODE ) ;
+        extantLngs.insert( lng, lngNode ) ;
+        if ( roots.sparse() )
+            roots.squeeze( [this]( NodeHandle root, uint32_t slot ) { nodes.hot( root ).slot = slot ; } ) ;
+        nodes.hot( lngNode ).slot = roots.add( lngNode ) ;
+        ++nnodes ;
+        TREE_STATS_UPDATE( countAllocation() ; )
+        
+    } ;
+    
+    /*
+     
+     Removes lineage 'lng' that became extinct.
+     
+     'lng' could be EXTREMAL (i.e. with no children) or INTERNAL within the tree.
+     
+     'lng' could be SAMPLED or UNSAMPLED.
+     
+     If 'lng' is NOT SAMPLED, do the following:
+     
+        Check if 'lng' is EXTREMAL or INTERNAL:
+     
+            a. if EXTREMAL, check if lng is ROOT
+                i.. if YES, remove 'lng' from the root list
                 ii. if NOT, notify its parent about 'lng' removal (call 'notifyParent').
             b. if INTERNAL with exactly one child, prune 'lng'
                and attach its only child to its parent (call 'mergeParent').
      
-    */
-    void removeExtantLineage( const T& lng, bool ignore_sampled = false )  {
+    */
+    void removeExtantLineage( const T& lng, bool ignore_sampled = false )  {
+        
+        NodeHandle lngNode = extantLngs.take( lng ) ; // lng is not extant anymore, hence update extant list
+        assert( lngNode != NULL_NODE ) ;
+        removeNode( lngNode, ignore_sampled ) ;
+        
+    } ;
+    
+    
+    /*
+     Marks lineage 'lng' as SAMPLED.
+     
+     Also adds additional info about the time of sampling 't' and the location
+     of sampling 'locSample' (optional), either as an ID (see 'addLocation')
+     or as a name, which is then added to the locations of the tree.
+     
+     Returns 'true' if the lineage is sampled successfully. Returns 'false' if not,
+     i.e. if it had been sampled already. This prevents a lineage from being sampled twice
+     and is relevant in models where sampled lineages are not removed right after sampling.
+     
+     The lineage is sampled in the default scheme, or in 'schemes' (see
+     'addSamplingScheme'). A lineage may be sampled again in other schemes:
+     it keeps the time and location of its first sampling.
+     
+     */
+    
+    bool sampleExtantLineage( const T& lng, const double& t, const std::string& locSample ) {
+        
+        return sampleExtantLineage( lng, t, locations.intern( locSample ) ) ;
+        
+    } ;
+    
+    bool sampleExtantLineage( const T& lng, const double& t, LocationID locSample = LOCATION_DEFAULT ) {
+        
+        return sampleExtantLineage( lng, t, SchemeSet::single( SCHEME_DEFAULT ), locSample ) ;
+        
+    } ;
+    
+    bool sampleExtantLineage( const T& lng, const double& t, SchemeSet schemes, LocationID locSample = LOCATION_DEFAULT ) {
+        
+        assert( locSample < locations.size() ) ; // unknown location
+        assert( !schemes.empty() and ( schemes.bits() >> schemeNames.size() ) == 0 ) ; // unknown scheme
+        
+        NodeHandle lngNode = extantLngs.find( lng ) ;
+        assert( lngNode != NULL_NODE ) ;
+        
+        if ( !sampleNode( lngNode, t, locSample, schemes ) ) // lng has already been sampled (in these schemes)
+            return false ;
+        
+        extantLngs.markSampled( lng ) ;
+        return true ;
+
+    } ;
+    
+    
+    /*
+     
+     Batched versions of 'addExtantLineage', 'sampleExtantLineage' and
+     'removeExtantLineage', for simulators that generate events in blocks
+     (e.g. tau-leaping or agent-based models).
+     
+     Events are applied in order, hence the resulting trees are identical
+     to those of the per-event calls (e.g. lineages born in a block may
+     have children, be sampled and be removed in the same block).
+     Identifiers of a block are resolved in one pass over the index, room
+     for new nodes is reserved once, and nodes of upcoming events are
+     prefetched while the current one is applied.
+     
+     */
+    
+    void addExtantLineages( const std::vector<BirthEvent<T,U>>& events ) {
+        
+        nodes.reserveExtra( events.size() ) ;
+        extantLngs.reserve( extantLngs.size() + events.size() ) ;
+        
+        resolveLineages( events, []( const BirthEvent<T,U>& ev ) -> const T& { return ev.lngParent ; } ) ;
+        
+        for ( std::size_t i = 0; i < events.size(); ++i ) {
+            
+            prefetchBatch( i ) ;
+            NodeHandle lngParentNode = batchHandles[i] ;
+            if ( lngParentNode == NULL_NODE ) // parent born earlier in this block
+                lngParentNode = extantLngs.find( events[i].lngParent ) ;
+            assert( lngParentNode != NULL_NODE ) ; // parent must be extant
+            addChildNode( events[i].t, events[i].lng, events[i].data, lngParentNode ) ;
+            
+        }
+        
+    }
+    
+    /*
+     Returns the number of lineages sampled successfully (see 'sampleExtantLineage').
+     */
+    std::size_t sampleExtantLineages( const std::vector<SamplingEvent<T>>& events ) {
+        
+        resolveLineages( events, []( const SamplingEvent<T>& ev ) -> const T& { return ev.lng ; } ) ;
+        
+        std::size_t nsampled = 0 ;
+        for ( std::size_t i = 0; i < events.size(); ++i ) {
+            
+            assert( events[i].locSample < locations.size() ) ; // unknown location
+            assert( batchHandles[i] != NULL_NODE ) ; // must be extant
+            prefetchBatch( i ) ;
+            
+            if ( sampleNode( batchHandles[i], events[i].t, events[i].locSample, events[i].schemes ) ) {
+                extantLngs.markSampled( events[i].lng ) ;
+                ++nsampled ;
+            }
+            
+        }
+        return nsampled ;
+        
+    }
+    
+    void removeExtantLineages( const std::vector<T>& lngs ) {
+        
+        /*
+         Extant nodes are never released by the pruning cascades of other
+         lineages, hence handles resolved (and dropped from the index) up
+         front stay valid until their own removal.
+         */
+        batchHandles.clear() ;
+        for ( const T& lng : lngs ) {
+            
+            NodeHandle lngNode = extantLngs.take( lng ) ;
+            assert( lngNode != NULL_NODE ) ; // must be extant, and listed once
+            batchHandles.push_back( lngNode ) ;
+            
+        }
+        
+        for ( std::size_t i = 0; i < batchHandles.size(); ++i ) {
+            
+            prefetchBatch( i ) ;
+            removeNode( batchHandles[i], false ) ;
+            
+        }
+        
+    }
+    
+    
+    /*
+     
+     Retrieves all SAMPLED lineages descending from 'rootNode', i.e. all lineages
+     that were marked as SAMPLED via 'sampleExtantLineage'.
+     
+     N.B.The result may include extinct sampled lineages too.
+     
+     */
+    
+    std::vector<T> getSampledLineages( NodeHandle rootNode )  {
+        
+        // return empty vector if not root
+        if ( nodes.hot( rootNode ).parent != NULL_NODE )
+            return {} ;
+        
+        // find all sampled lineages (visits only subtrees with sampled nodes)
+        struct Collector {
+            
+            const Pool& nodes ;
+            std::vector<T> lngs ;
+            
+            bool enter( NodeHandle node ) {
+                
+                if ( nodes.hot( node ).sampled ) // if sampled, add node to vector
+                    lngs.push_back( nodes.cold( node ).lng ) ;
+                return nodes.hot( node ).hasSampled ;
+                
+            }
+            
+            void leave( NodeHandle ) {}
+            
+        } collector{ nodes, {} } ;
+        
+        traverseDepthFirst( rootNode, TrackingChildren{ nodes }, collector ) ;
+        std::vector<T> sampledLngs = std::move( collector.lngs ) ;
+        
+        return sampledLngs ;
+        
+    } ;
+    
+    /*
+     
+     Returns 'true' if 'lng' has already been sampled.
+     It is useful for external code in order to avoid sampling the same lineage twice
+     
+     */
+    bool is_lineage_sampled( const T& lng ) {
+        
+        return extantLngs.isSampled( lng ) ;
+        
+    }
+    
+    /*
+     
+     Sampled lineages with sampling times in 'window', by increasing
+     sampling time (ties in the order of sampling), and their number.
+     
+     Sampled lineages are indexed by sampling time as they are sampled,
+     hence queries cost O( log n ) plus the size of the result (the index
+     is sorted once after lineages sampled out of time order).
+     
+     */
+    
+    std::vector<T> getSampledLineages( const SamplingWindow& window ) {
+        
+        std::vector<T> lngs ;
+        auto range = findSamples( window ) ;
+        lngs.reserve( range.second - range.first ) ;
+        for ( auto it = range.first; it != range.second; ++it )
+            lngs.push_back( nodes.cold( it->node ).lng ) ;
+        return lngs ;
+        
+    }
+    
+    std::size_t countSampledLineages( const SamplingWindow& window ) {
+        
+        auto range = findSamples( window ) ;
+        return range.second - range.first ;
+        
+    }
+
+
+    //std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree( const std::unordered_map<T,DataLineageSampling,Hash>& sampledLngsInfo ) ;
+    
+    
+    /*
+     
+     Yields the reduced transmission tree from the full transmission tree.
+     
+     Keeps only sampled EXTREMAL (and INTERNAL) nodes that were marked as
+     SAMPLED or that are instrumental to draw the ancestry of SAMPLED
+     lineages.
+     
+     Returns a vector with multiple trees corresponding to disjoint trees
+     (happens when sampled lineages descend from distinct introductions)
+     
+     Each tree is built in a single post-order pass (see 'reduceSubTree')
+     restricted to subtrees with sampled nodes, hence the cost scales with
+     the number of sampled lineages and their ancestors, not with the size
+     of the whole transmission forest. This makes it cheap to take trees at
+     many time points during a simulation.
+     
+     */
+    
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree()  {
+        
+        TREE_STATS_UPDATE( auto start = std::chrono::steady_clock::now() ; )
+        
+        // loop over root nodes
+        std::vector<LineageTreeNode<T,U,Hash>*> res = {} ;
+        for ( const ChainTable::Chain& chain : roots ) {
+            
+            if ( !chain.sampled ) // no sampled lineages (or removed)
+                continue ;
+            
+            LineageTreeNode<T,U,Hash>* subTreeRoot = reduceSubTree( chain.root ) ;
+            
+            if ( subTreeRoot != nullptr ) // has sampled lineages
+                res.push_back( subTreeRoot ) ;
+
+        }
+        
+        TREE_STATS_UPDATE(
+            ++stats.subSampleCalls ;
+            stats.subSampleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+        )
+        
+        return res ;
+        
+    } ;
+    
+    /*
+     
+     Variant of 'subSampleTree()' keeping as tips only the lineages sampled
+     in 'window', e.g. 'tree.subSampleTree( { t0, t1 } )'. Lineages sampled
+     outside the window are treated as unsampled. Trees are in the order of
+     'subSampleTree()'.
+     
+     Tips are found with the sampling time index (see 'getSampledLineages'),
+     then only their ancestors are visited, hence the cost scales with the
+     number of tips in the window and their ancestors.
+     
+     */
+    
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree( const SamplingWindow& window ) {
+        
+        TREE_STATS_UPDATE( auto start = std::chrono::steady_clock::now() ; )
+        
+        auto range = findSamples( window ) ;
+        markedNodes.clear() ;
+        for ( auto it = range.first; it != range.second; ++it )
+            markAncestors( it->node ) ;
+        
+        struct InWindow {
+            SamplingWindow window ;
+            bool operator()( const Pool& nodes, NodeHandle node ) const { return window.contains( nodes.cold( node ).tSample ) ; }
+        } ;
+        std::vector<LineageTreeNode<T,U,Hash>*> res = subSampleMarked( InWindow{ window } ) ;
+        
+        TREE_STATS_UPDATE(
+            ++stats.subSampleCalls ;
+            stats.subSampleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+        )
+        
+        return res ;
+        
+    } ;
+    
+    /*
+     
+     Variant of 'subSampleTree()' keeping as tips only the lineages sampled
+     in any of 'schemes' (see 'addSamplingScheme'), e.g. the trees of one
+     sampling scheme among those tracked in the same run. 'subSampleTree()'
+     keeps the lineages sampled in any scheme.
+     
+     */
+    
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree( SchemeSet schemes ) {
+        
+        TREE_STATS_UPDATE( auto start = std::chrono::steady_clock::now() ; )
+        
+        markedNodes.clear() ;
+        for ( const SampleEntry& entry : samplesByTime ) {
+            if ( schemes.intersects( SchemeSet::fromBits( nodes.cold( entry.node ).schemes ) ) )
+                markAncestors( entry.node ) ;
+        }
+        
+        struct InSchemes {
+            SchemeSet schemes ;
+            bool operator()( const Pool& nodes, NodeHandle node ) const { return schemes.intersects( SchemeSet::fromBits( nodes.cold( node ).schemes ) ) ; }
+        } ;
+        std::vector<LineageTreeNode<T,U,Hash>*> res = subSampleMarked( InSchemes{ schemes } ) ;
+        
+        TREE_STATS_UPDATE(
+            ++stats.subSampleCalls ;
+            stats.subSampleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+        )
+        
+        return res ;
+        
+    } ;
+    
+    /*
+     
+     Parallel counterpart of 'subSampleTree' on 'nthreads' threads: yields
+     the same trees, in the same order.
+     
+     Chains are reduced concurrently. Chains with more than 'grain' sampled
+     lineages are split further, so that a single large chain does not hold
+     up the others: their subtrees with at most 'grain' sampled lineages are
+     reduced as separate tasks (except tiny ones, left to the top part), then
+     the top part of the chain is reduced on top of them.
+     
+     If 'cuts' is given, it receives the representatives of these subtrees
+     (see 'extractForest').
+     
+     */
+    
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleTree( unsigned nthreads, std::size_t grain = 4096, std::vector<LineageTreeNode<T,U,Hash>*>* cuts = nullptr ) {
+        
+        TREE_STATS_UPDATE( auto start = std::chrono::steady_clock::now() ; )
+        
+        struct Task {
+            NodeHandle node ;
+            bool isRoot ;
+            LineageTreeNode<T,U,Hash>* rep ;
+        } ;
+        
+        // count the sampled lineages below nodes with samples (all chains concurrently)
+        struct Counter {
+            
+            const Pool& nodes ;
+            std::vector<uint32_t>& counts ; // by node handle
+            
+            bool enter( NodeHandle node ) {
+                
+                if ( !nodes.hot( node ).hasSampled )
+                    return false ;
+                counts[node] = nodes.hot( node ).sampled ? 1 : 0 ;
+                return true ;
+                
+            }
+            
+            void leave( NodeHandle node ) {
+                
+                NodeHandle parent = nodes.hot( node ).parent ;
+                if ( nodes.hot( node ).hasSampled and parent != NULL_NODE )
+                    counts[parent] += counts[node] ;
+                
+            }
+            
+        } ;
+        
+        std::vector<NodeHandle> chains ; // in the order of 'subSampleTree()'
+        for ( const ChainTable::Chain& chain : roots )
+            if ( chain.sampled ) // else no sampled lineages (or removed)
+                chains.push_back( chain.root ) ;
+        
+        std::vector<uint32_t> counts( nodes.endHandle() ) ;
+        parallelFor( chains.size(), nthreads, [&]( std::size_t i ) {
+            Counter counter{ nodes, counts } ;
+            traverseDepthFirst( chains[i], TrackingChildren{ nodes }, counter ) ;
+        } ) ;
+        
+        // collect tasks: small chains, and subtrees of large chains
+        struct Splitter {
+            
+            const Pool& nodes ;
+            const std::vector<uint32_t>& counts ;
+            std::size_t grain ;
+            std::vector<Task>& tasks ;
+            
+            bool enter( NodeHandle node ) {
+                
+                std::size_t nSampled = nodes.hot( node ).hasSampled ? counts[node] : 0 ;
+                if ( nSampled > grain ) // too large: split
+                    return true ;
+                
+                if ( nSampled > 0 and nSampled >= grain / 16 )
+                    tasks.push_back( Task{ node, false, nullptr } ) ;
+                return false ;
+                
+            }
+            
+            void leave( NodeHandle ) {}
+            
+        } ;
+        
+        const std::size_t NO_TASK = static_cast<std::size_t>( -1 ) ;
+        std::vector<std::size_t> chainTasks ; // task of each chain (NO_TASK if large)
+        std::vector<NodeHandle> largeChains ;
+        std::vector<Task> tasks ;
+        Splitter splitter{ nodes, counts, grain, tasks } ;
+        
+        for ( NodeHandle rootNode : chains ) {
+            
+            if ( counts[rootNode] <= grain ) {
+                chainTasks.push_back( tasks.size() ) ;
+                tasks.push_back( Task{ rootNode, true, nullptr } ) ;
+            }
+            else {
+                chainTasks.push_back( NO_TASK ) ;
+                largeChains.push_back( rootNode ) ;
+                traverseDepthFirst( rootNode, TrackingChildren{ nodes }, splitter ) ;
+            }
+            
+        }
+        
+        parallelFor( tasks.size(), nthreads, [&]( std::size_t i ) {
+            tasks[i].rep = reduceSubTree( tasks[i].node, tasks[i].isRoot ) ;
+        } ) ;
+        
+        // top parts of large chains
+        FlatHashMap<NodeHandle, LineageTreeNode<T,U,Hash>*> reduced ;
+        for ( const Task& task : tasks ) {
+            if ( !task.isRoot ) {
+                reduced.insert( task.node, task.rep ) ;
+                if ( cuts != nullptr and task.rep != nullptr )
+                    cuts->push_back( task.rep ) ;
+            }
+        }
+        
+        std::vector<LineageTreeNode<T,U,Hash>*> largeReps( largeChains.size() ) ;
+        parallelFor( largeChains.size(), nthreads, [&]( std::size_t i ) {
+            largeReps[i] = reduceSubTree( largeChains[i], true, &reduced ) ;
+        } ) ;
+        
+        std::vector<LineageTreeNode<T,U,Hash>*> res = {} ;
+        std::size_t nlarge = 0 ;
+        for ( std::size_t i = 0; i < chains.size(); ++i ) {
+            
+            LineageTreeNode<T,U,Hash>* subTreeRoot = ( chainTasks[i] != NO_TASK ) ? tasks[ chainTasks[i] ].rep : largeReps[ nlarge++ ] ;
+            if ( subTreeRoot != nullptr ) // has sampled lineages
+                res.push_back( subTreeRoot ) ;
+            
+        }
+        
+        TREE_STATS_UPDATE(
+            ++stats.subSampleCalls ;
+            stats.subSampleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+        )
+        
+        return res ;
+        
+    } ;
+
+    /*
+     
+     Captures the current reduced transmission forest as an immutable
+     snapshot, e.g. to draw trees at several times of the same simulation.
+     't' is only recorded (see 'LineageTreeSnapshot::getTime').
+     
+     Reduced subtrees are cached per node and reused by later snapshots
+     for as long as no sampled node below was sampled or removed, hence
+     the cost of a snapshot mostly depends on what changed since the
+     previous one. Each snapshot starts a new epoch (see 'invalidateSnapshots').
+     
+     */
+    
+    LineageTreeSnapshot<T,U,Hash> takeSnapshot( const double& t = 0. ) {
+        
+        ++snapshotEpoch ;
+        
+        std::vector<std::shared_ptr<const SnapshotNode<T,U>>> res = {} ;
+        for ( const ChainTable::Chain& chain : roots ) {
+            
+            if ( !chain.sampled ) // no sampled lineages (or removed)
+                continue ;
+            
+            res.push_back( snapshotSubTree( chain.root ) ) ;
+            
+        }
+        
+        return LineageTreeSnapshot<T,U,Hash>( t, std::move( res ), locations ) ;
+        
+    } ;
+    
+    /*
+     
+     Returns the ROOT node of the tree containing 'lngNode'.
+     
+     N.B. if 'lngNode' is ROOT, it returns itself.
+     
+     */
+    
+    LineageTreeNode<T,U,Hash>* getRootNode( LineageTreeNode<T,U,Hash>* lngNode )  {
+        
+        while ( lngNode->parent != nullptr )
+            lngNode = lngNode->parent ;
+        
+        return lngNode ;
+        
+    } ;
+
+    /*
+     
+     Returns the ID of sampling location 'name', adding it if needed.
+     Looking IDs up once avoids hashing names at every sampling event.
+     
+     */
+    
+    LocationID addLocation( const std::string& name ) { return locations.intern( name ) ; }
+    
+    /*
+     
+     Returns sampling scheme 'name' (see 'Sampling schemes'), adding it if
+     needed, and the names of schemes by ID. Like locations, schemes persist
+     across calls to 'reset'.
+     
+     */
+    
+    SchemeSet addSamplingScheme( const std::string& name ) {
         
-        LineageTreeNode<T,U>* lngNode = extantLngs[lng] ;
-        lngNode->extant = false ;
+        std::size_t id = std::find( schemeNames.begin(), schemeNames.end(), name ) - schemeNames.begin() ;
+        if ( id == schemeNames.size() ) {
+            assert( schemeNames.size() < MAX_SCHEMES ) ; // too many schemes
+            schemeNames.push_back( name ) ;
+        }
+        return SchemeSet::single( static_cast<SchemeID>( id ) ) ;
+        
+    }
+    
+    const std::vector<std::string>& getSamplingSchemes() const { return schemeNames ; }
+    
+    /*
+     
+     Returns the sampling locations (e.g. to resolve IDs when writing trees).
+     
+     N.B. locations persist across calls to 'reset', hence IDs remain valid.
+     
+     */
+    
+    const LocationDictionary& getLocations() const { return locations ; }
+    
+    /*
+     
+     Returns statistics about memory usage and pruning work (all zero unless
+     compiled with TREE_STATS, see 'Statistics'). Reset by 'reset'.
+     
+     */
+    
+    const LineageTreeStats& getStats() const { return stats ; }
+    
+    /*
+     
+     Returns the number of extant lineages.
+     
+     */
+    
+    uint getSizeExtantLineages() {
+        
+        return static_cast<uint>( extantLngs.size() ) ;
+        
+    }
+    
+    /*
+     
+     Returns the number of nodes.
+     
+     */
+    
+    uint getSizeNodes() { return nnodes ; }
+    
+    /*
+     
+     Returns the number of transmission chains (resp. of chains with sampled
+     lineages). Chains whose lineages are all extinct and unsampled are
+     removed as soon as they are pruned.
+     
+     */
+    
+    std::size_t getSizeChains() const { return roots.size() ; }
+    
+    std::size_t getSizeSampledChains() const { return roots.sizeSampled() ; }
+    
+    /*
+     
+     Checkpoints: 'save' writes the whole state of the tree (nodes, extant
+     and sampled lineages, locations) and 'load' restores it, e.g. to resume
+     an interrupted simulation or to fork scenarios from a common state.
+     Nodes are written one at a time, hence no copy of the tree is built.
+     
+     Identifiers and metadata are written with 'saveValue' (see 'binary_io.hpp').
+     Handles are kept as they are, hence a restored tree goes on exactly as
+     the original one would have. Statistics are not saved (reset by 'load').
+     
+     'load' returns 'false' (and leaves the tree empty) if the data are
+     truncated or were written for other types 'T' or 'U'.
+     
+     N.B. the index of lineages is rebuilt from the nodes rather than saved.
+     
+     */
+    
+    void save( BinaryWriter& out ) const {
+        
+        out.writeString( checkpointTag() ) ;
+        out.write<uint32_t>( CHECKPOINT_VERSION ) ;
+        out.write<uint32_t>( sizeof( T ) ) ;
+        out.write<uint32_t>( sizeof( U ) ) ;
+        
+        out.write<uint32_t>( static_cast<uint32_t>( locations.size() ) ) ;
+        for ( std::size_t id = LOCATION_DEFAULT + 1; id < locations.size(); ++id )
+            out.writeString( locations.name( static_cast<LocationID>( id ) ) ) ;
+        
+        out.write<uint32_t>( static_cast<uint32_t>( schemeNames.size() ) ) ;
+        for ( std::size_t id = SCHEME_DEFAULT + 1; id < schemeNames.size(); ++id )
+            out.writeString( schemeNames[id] ) ;
         
-        bool proceed = true ;
-        if ( lngNode->sampled )
-            proceed = false ;
+        out.write<uint32_t>( nnodes ) ;
+        out.write<uint64_t>( nodes.endHandle() ) ;
+        out.writeVector( nodes.getFreeHandles() ) ;
         
-        if ( proceed ) { // remove node only if not sampled
+        std::vector<bool> isFree( nodes.endHandle(), false ) ;
+        for ( NodeHandle h : nodes.getFreeHandles() )
+            isFree[h] = true ;
+        
+        for ( std::size_t i = 0; i < nodes.endHandle(); ++i ) {
             
-            if ( ( lngNode->children ).size() == 0 ) { // has no extant children
-                
-                if ( lngNode->parent != nullptr ) // if parent is not ROOT, broadcast removal upstream
-                    notifyParent( lngNode->parent, lngNode, ignore_sampled ) ;
-                else
-                    roots.erase( lngNode ) ; // remove from root
-                
-                delete lngNode ;
-                --nnodes;
-                
+            if ( isFree[i] )
+                continue ;
+            
+            const Hot& hot = nodes.hot( static_cast<NodeHandle>( i ) ) ;
+            out.write( hot.tBranchParent ) ;
+            out.write( hot.parent ) ;
+            out.write( hot.slot ) ;
+            out.write<uint8_t>( ( hot.extant ? 1 : 0 ) | ( hot.sampled ? 2 : 0 ) | ( hot.hasSampled ? 4 : 0 ) ) ;
+            out.write( hot.children.size() ) ;
+            out.writeArray( hot.children.data(), hot.children.size() ) ;
+            
+            const Cold& cold = nodes.cold( static_cast<NodeHandle>( i ) ) ;
+            out.write( cold.t ) ;
+            out.write( cold.tSample ) ;
+            saveValue( out, cold.lng ) ;
+            saveValue( out, cold.data ) ;
+            out.write( cold.locSample ) ;
+            out.write( cold.schemes ) ;
+            
+        }
+        
+        out.write<uint64_t>( roots.size() ) ;
+        for ( const ChainTable::Chain& chain : roots ) {
+            if ( chain.root != NULL_NODE )
+                out.write( chain.root ) ;
+        }
+        
+    } ;
+    
+    bool load( BinaryReader& in ) {
+        
+        reset() ;
+        
+        if ( in.readString() != checkpointTag() or in.read<uint32_t>() != CHECKPOINT_VERSION
+             or in.read<uint32_t>() != sizeof( T ) or in.read<uint32_t>() != sizeof( U ) )
+            in.fail() ;
+        
+        uint32_t nlocations = in.read<uint32_t>() ;
+        locations = LocationDictionary() ;
+        for ( uint32_t id = LOCATION_DEFAULT + 1; id < nlocations and in.ok(); ++id ) {
+            if ( locations.intern( in.readString() ) != id ) // names must be unique
+                in.fail() ;
+        }
+        
+        uint32_t nschemes = in.read<uint32_t>() ;
+        schemeNames.resize( SCHEME_DEFAULT + 1 ) ;
+        if ( nschemes > MAX_SCHEMES )
+            in.fail() ;
+        for ( uint32_t id = SCHEME_DEFAULT + 1; id < nschemes and in.ok(); ++id ) {
+            std::string name = in.readString() ;
+            if ( std::find( schemeNames.begin(), schemeNames.end(), name ) != schemeNames.end() ) // names must be unique
+                in.fail() ;
+            schemeNames.push_back( name ) ;
+        }
+        
+        nnodes = in.read<uint32_t>() ;
+        uint64_t nhandles = in.read<uint64_t>() ;
+        std::vector<NodeHandle> freeHandles ;
+        in.readVector( freeHandles ) ;
+        if ( !in.ok() or nhandles >= NULL_NODE or freeHandles.size() > nhandles or nnodes != nhandles - freeHandles.size() ) {
+            reset() ;
+            return false ;
+        }
+        
+        std::vector<bool> isFree( nhandles, false ) ;
+        for ( NodeHandle h : freeHandles ) {
+            if ( h >= nhandles or isFree[h] )
+                in.fail() ;
+            else
+                isFree[h] = true ;
+        }
+        
+        nodes.restore( nhandles, freeHandles ) ;
+        
+        for ( std::size_t i = 0; i < nhandles and in.ok(); ++i ) {
+            
+            if ( isFree[i] )
+                continue ;
+            
+            NodeHandle h = static_cast<NodeHandle>( i ) ;
+            Hot& hot = nodes.hot( h ) ;
+            hot.tBranchParent = in.read<double>() ;
+            hot.parent = in.read<NodeHandle>() ;
+            hot.slot = in.read<uint32_t>() ;
+            hot.version = 0 ; // snapshots are not restored
+            uint8_t flags = in.read<uint8_t>() ;
+            hot.extant = ( flags & 1 ) != 0 ;
+            hot.sampled = ( flags & 2 ) != 0 ;
+            hot.hasSampled = ( flags & 4 ) != 0 ;
+            hot.released = false ;
+            
+            uint32_t nchildren = in.read<uint32_t>() ;
+            hot.children.clear() ;
+            for ( uint32_t k = 0; k < nchildren and in.ok(); ++k ) {
+                NodeHandle child = in.read<NodeHandle>() ;
+                if ( child >= nhandles or isFree[child] )
+                    in.fail() ;
+                hot.children.push_back( child ) ;
+            }
+            if ( hot.parent != NULL_NODE and ( hot.parent >= nhandles or isFree[hot.parent] ) )
+                in.fail() ;
+            
+            Cold& cold = nodes.cold( h ) ;
+            cold.t = in.read<double>() ;
+            cold.tSample = in.read<double>() ;
+            loadValue( in, cold.lng ) ;
+            loadValue( in, cold.data ) ;
+            cold.locSample = in.read<LocationID>() ;
+            cold.schemes = in.read<uint32_t>() ;
+            if ( cold.locSample >= locations.size() or ( cold.schemes >> schemeNames.size() ) != 0 or ( cold.schemes != 0 ) != hot.sampled )
+                in.fail() ;
+            
+            if ( !in.ok() )
+                break ;
+            
+            if ( hot.extant )
+                extantLngs.insert( cold.lng, h ) ;
+            if ( hot.sampled ) {
+                extantLngs.markSampled( cold.lng ) ;
+                samplesByTime.push_back( { cold.tSample, h } ) ;
+            }
+            else if ( !hot.extant ) // left by lazy pruning, if any
+                deferred.push_back( h ) ;
+            
+        }
+        
+        uint64_t nroots = in.read<uint64_t>() ;
+        for ( uint64_t k = 0; k < nroots and in.ok(); ++k ) {
+            NodeHandle root = in.read<NodeHandle>() ;
+            if ( root >= nhandles or isFree[root] or nodes.hot( root ).parent != NULL_NODE )
+                in.fail() ;
+            else {
+                nodes.hot( root ).slot = roots.add( root, nodes.hot( root ).hasSampled ) ;
             }
+        }
+        
+        if ( !in.ok() ) {
+            reset() ;
+            return false ;
+        }
+        samplesSorted = false ;
+        if ( !lazyPruning ) // prune nodes left by lazy pruning, if any
+            compact() ;
+        return true ;
+        
+    } ;
+    
+private:
+    enum { CHECKPOINT_VERSION = 3 } ; // version of the format written by 'save'
+    static const char* checkpointTag() { return "LineageTree" ; }
+    
+    uint nnodes ;
+    Pool nodes ; // owns all nodes of the transmission forest
+    Index extantLngs ; // list of extant lineages (and of sampled ones)
+    ChainTable roots ; // roots, i.e. trees, in order of introduction
+    LocationDictionary locations ; // sampling locations
+    std::vector<std::string> schemeNames ; // sampling schemes, by ID
+    LineageTreeStats stats ;
+    std::vector<NodeHandle> pendingRelease ; // scratch list of 'notifyParent'
+    std::vector<NodeHandle> batchHandles ; // scratch list of batched updates (see 'resolveLineages')
+    
+    bool lazyPruning ; // see 'setLazyPruning'
+    std::size_t lazyMaxNodes ;
+    std::size_t compactAt ; // number of nodes that triggers the next sweep
+    std::vector<NodeHandle> deferred ; // lineages removed since the last sweep (not sampled)
+    
+    struct SampleEntry {
+        double tSample ;
+        NodeHandle node ; // sampled nodes are never released
+        bool operator<( const SampleEntry& other ) const { return tSample < other.tSample or ( tSample == other.tSample and node < other.node ) ; }
+    } ;
+    std::vector<SampleEntry> samplesByTime ; // sampled nodes, by sampling time once sorted
+    bool samplesSorted ; // 'false' if a lineage was sampled out of order since the last query
+    FlatHashSet<NodeHandle> markedNodes ; // scratch set of 'markAncestors'
+    
+    uint32_t snapshotEpoch ; // number of snapshots taken (0: no cached subtrees to invalidate)
+    struct SnapshotCacheEntry {
+        uint32_t epoch ; // snapshot epoch in which 'rep' was built
+        std::shared_ptr<const SnapshotNode<T,U>> rep ; // reduced subtree
+    } ;
+    std::vector<SnapshotCacheEntry> snapshotCache ; // indexed by node handle
+    //std::unordered_map<LineageTreeNode<T,U,Hash>*, std::pair<LineageTreeNode<T,U,Hash>*, double>> parent_info ;
+    
+    /*
+     
+     Children accessor of pool nodes (see 'traverseDepthFirst').
+     
+     */
+    
+    struct TrackingChildren {
+        
+        const Pool& nodes ;
+        std::size_t nChildren( NodeHandle node ) const { return nodes.hot( node ).children.size() ; }
+        NodeHandle child( NodeHandle node, std::size_t i ) const { return nodes.hot( node ).children[ static_cast<uint32_t>( i ) ] ; }
+        
+    } ;
+    
+    /*
+     
+     Tip filters of 'reduceSubTree':
+     
+        bool visit( const Pool& nodes, NodeHandle node ) const ; // false if no tip descends from 'node'
+        bool tip( const Pool& nodes, NodeHandle node ) const ; // whether sampled 'node' is a tip
+     
+     'AllSampled' keeps all sampled nodes. 'MarkedTips' keeps the tips
+     selected by 'tip', whose ancestors are listed in 'marked' (see
+     'markAncestors').
+     
+     */
+    
+    struct AllSampled {
+        
+        bool visit( const Pool& nodes, NodeHandle node ) const { return nodes.hot( node ).hasSampled ; }
+        bool tip( const Pool&, NodeHandle ) const { return true ; }
+        
+    } ;
+    
+    template <class Tip>
+    struct MarkedTips {
+        
+        const FlatHashSet<NodeHandle>& marked ;
+        Tip isTip ;
+        bool visit( const Pool&, NodeHandle node ) const { return marked.contains( node ) ; }
+        bool tip( const Pool& nodes, NodeHandle node ) const { return isTip( nodes, node ) ; }
+        
+    } ;
+    
+    /*
+     
+     Range of 'samplesByTime' with sampling times in 'window'.
+     
+     */
+    
+    std::pair<typename std::vector<SampleEntry>::const_iterator, typename std::vector<SampleEntry>::const_iterator> findSamples( const SamplingWindow& window ) {
+        
+        if ( !samplesSorted ) {
+            std::sort( samplesByTime.begin(), samplesByTime.end() ) ;
+            samplesSorted = true ;
+        }
+        
+        auto first = std::lower_bound( samplesByTime.begin(), samplesByTime.end(), window.t0, []( const SampleEntry& e, double t ) { return e.tSample < t ; } ) ;
+        auto last = std::upper_bound( first, samplesByTime.end(), window.t1, []( double t, const SampleEntry& e ) { return t < e.tSample ; } ) ; // 'first' if t1 < t0
+        return std::make_pair( typename std::vector<SampleEntry>::const_iterator( first ), typename std::vector<SampleEntry>::const_iterator( last ) ) ;
+        
+    }
+    
+    /*
+     
+     Lists in 'markedNodes' the tip 'tip' and all its ancestors. Each node
+     is listed once: the walk up stops at the first node listed already.
+     
+     */
+    
+    void markAncestors( NodeHandle tip ) {
+        
+        for ( NodeHandle h = tip; h != NULL_NODE and markedNodes.insert( h ); h = nodes.hot( h ).parent ) {}
+        
+    }
+    
+    /*
+     
+     Reduced trees of the roots listed in 'markedNodes', in the order of
+     'subSampleTree()', with tips selected by 'tip'.
+     
+     */
+    
+    template <class Tip>
+    std::vector<LineageTreeNode<T,U,Hash>*> subSampleMarked( Tip tip ) {
+        
+        MarkedTips<Tip> filter{ markedNodes, tip } ;
+        
+        std::vector<LineageTreeNode<T,U,Hash>*> res ;
+        for ( const ChainTable::Chain& chain : roots ) {
             
-            // check if merge is possible
-            else if ( ( lngNode->children ).size() == 1 )
-                mergeParentChild( lngNode ) ;
+            if ( !chain.sampled or !markedNodes.contains( chain.root ) )
+                continue ;
             
-            // else, must keep node
+            LineageTreeNode<T,U,Hash>* subTreeRoot = reduceSubTree( chain.root, true, nullptr, filter ) ;
+            if ( subTreeRoot != nullptr )
+                res.push_back( subTreeRoot ) ;
             
         }
+        return res ;
+        
+    }
+    
+    /*
+     
+     Clears statistics (see 'getStats').
+     
+     */
+    
+    void resetStats() {
+        
+#ifdef TREE_STATS
+        stats.enabled = true ;
+#else
+        stats.enabled = false ;
+#endif
+        stats.nodesAllocated = 0 ;
+        stats.nodesFreed = 0 ;
+        stats.merges = 0 ;
+        stats.peakNodes = 0 ;
+        stats.bytesPerNode = sizeof( Hot ) + sizeof( Cold ) ;
+        stats.cascadeDepths.clear() ;
+        stats.compactions = 0 ;
+        stats.subSampleCalls = 0 ;
+        stats.subSampleSeconds = 0. ;
+        
+    } ;
+    
+    void countAllocation() {
+        
+        ++stats.nodesAllocated ;
+        if ( nnodes > stats.peakNodes )
+            stats.peakNodes = nnodes ;
+        
+    } ;
+    
+    /*
+     
+     Initialises the (recycled) pool node 'node'.
+     
+     */
+    
+    void initNode( NodeHandle node, const T& lng, const U& data, const double& t, const bool& extant, NodeHandle parent ) {
+        
+        Hot& hot = nodes.hot( node ) ;
+        hot.tBranchParent = t ;
+        hot.parent = parent ;
+        hot.slot = 0 ;
+        hot.children.clear() ; // keeps capacity of recycled nodes
+        hot.version = 0 ;
+        hot.extant = extant ;
+        hot.sampled = false ;
+        hot.hasSampled = false ;
+        hot.released = false ;
+        
+        Cold& cold = nodes.cold( node ) ;
+        cold.t = t ;
+        cold.tSample = 0. ;
+        cold.lng = lng ;
+        cold.data = data ;
+        cold.locSample = LOCATION_NA ;
+        cold.schemes = 0 ;
+        
+    } ;
+    
+    /*
+     
+     Adds an extant lineage 'lng' as a child of 'parent' (see 'addExtantLineage').
+     
+     */
+    
+    void addChildNode( const double& t, const T& lng, const U& data, NodeHandle parent ) {
         
-        extantLngs.erase( lng ); // lng is not extant anymore, hence update extant list
+        NodeHandle lngNode = nodes.allocate() ; // allocate first: may invalidate node references
+        initNode( lngNode, lng, data, t, true, parent ) ;
+        attachChild( parent, lngNode ) ;
+        //lngParentNode->children_branching_times[lng] = t ;
+        extantLngs.insert( lng, lngNode ) ;
+        ++nnodes ;
+        TREE_STATS_UPDATE( countAllocation() ; )
         
     } ;
     
-    
     /*
-     Marks lineage 'lng' as SAMPLED.
-     
-     Also adds additional info about the time of sampling 't' and the location
-     of sampling 'locSample' (optional).
      
-     Returns 'true' if the lineage is sampled successfully. Returns 'false' if not,
-     i.e. if it had been sampled already. This prevents a lineage from being sampled twice
-     and is relevant in models where sampled lineages are not removed right after sampling.
+     Looks up the lineages 'lngOf( ev )' of a block of events in a single pass
+     over the index (into 'batchHandles', NULL_NODE if not extant), so that
+     their nodes can be prefetched while the previous events are applied.
      
      */
     
-    bool sampleExtantLineage( const T& lng, const double& t, const std::string& locSample = "@" ) {
+    template <class Event, class LngOf>
+    void resolveLineages( const std::vector<Event>& events, LngOf lngOf ) {
+        
+        batchHandles.resize( events.size() ) ;
+        for ( std::size_t i = 0; i < events.size(); ++i )
+            batchHandles[i] = extantLngs.find( lngOf( events[i] ) ) ;
         
-        if ( extantLngs[lng]->sampled ) // lng has already been sampled
-            return false ;
-        else { // lng has not been sampled already
-            
-            extantLngs[lng]->sampled = true ;
-            extantLngs[lng]->tSample = t ;
-            extantLngs[lng]->locSample = locSample ;
-            
-            sampled_lineages.insert( lng ) ;
-            return true ;
-            
-        }
-
     } ;
     
+    void prefetchBatch( std::size_t i ) const {
+        
+        const std::size_t distance = 8 ; // events ahead
+        if ( i + distance < batchHandles.size() and batchHandles[i + distance] != NULL_NODE )
+            nodes.prefetch( batchHandles[i + distance] ) ;
+        
+    } ;
     
     /*
      
-     Retrieves all SAMPLED lineages descending from 'rootNode', i.e. all lineages
-     that were marked as SAMPLED via 'sampleExtantLineage'.
-     
-     N.B.The result may include extinct sampled lineages too.
+     Marks 'lngNode' as extinct and prunes it if possible (see 'removeExtantLineage',
+     the lineage must already be dropped from the index).
      
      */
-
-    std::vector<T> getSampledLineages( LineageTreeNode<T,U>* rootNode )  {
+    
+    void removeNode( NodeHandle lngNode, bool ignore_sampled ) {
         
-        // return empty vector if not root
-        if ( rootNode->parent != nullptr )
-            return {} ;
+        nodes.hot( lngNode ).extant = false ;
         
-        // find all sampled lineages recursively
-        std::vector<T> sampledLngs = {} ;
-        getSampledLineagesRecursive( rootNode, sampledLngs ) ;
+        if ( nodes.hot( lngNode ).hasSampled ) // appears in reduced trees
+            invalidateSnapshots( lngNode ) ;
         
-        return sampledLngs ;
+        if ( nodes.hot( lngNode ).sampled ) // remove node only if not sampled
+            return ;
+        
+        if ( lazyPruning ) { // pruned by the next sweep
+            deferred.push_back( lngNode ) ;
+            if ( lazyMaxNodes > 0 and nnodes >= compactAt )
+                compact() ;
+            return ;
+        }
+        
+        pruneNode( lngNode, ignore_sampled ) ;
         
     } ;
     
     /*
      
-     Returns 'true' if 'lng' has already been sampled.
-     It is useful for external code in order to avoid sampling the same lineage twice
+     Prunes the extinct unsampled node 'lngNode' if it is redundant (see
+     'removeExtantLineage').
      
      */
-    bool is_lineage_sampled( const T& lng ) {
+    
+    void pruneNode( NodeHandle lngNode, bool ignore_sampled = false ) {
         
-        if ( sampled_lineages.find( lng ) != sampled_lineages.end() )
-            return true ;
-        else
-            return false ;
+        uint nChildren = nodes.hot( lngNode ).children.size() ;
         
-    }
-
-
-    //std::vector<LineageTreeNode<T,U>*> subSampleTree( const std::unordered_map<T,DataLineageSampling,Hash>& sampledLngsInfo ) ;
-    
+        if ( nChildren == 0 ) { // has no extant children
+            
+            if ( nodes.hot( lngNode ).parent != NULL_NODE ) // if parent is not ROOT, broadcast removal upstream
+                notifyParent( nodes.hot( lngNode ).parent, lngNode, ignore_sampled ) ;
+            else
+                roots.remove( nodes.hot( lngNode ).slot ) ; // remove from root
+            
+            releaseNode( lngNode ) ;
+            
+        }
+        
+        // check if merge is possible
+        else if ( nChildren == 1 )
+            mergeParentChild( lngNode ) ;
+        
+        // else, must keep node
+        
+    } ;
     
     /*
      
-     Yields the reduced transmission tree from the full transmission tree.
-     
-     Keeps only sampled EXTREMAL (and INTERNAL) nodes that were marked as
-     SAMPLED or that are instrumental to draw the ancestry of SAMPLED
-     lineages.
-     
-     Returns a vector with multiple trees corresponding to disjoint trees
-     (happens when sampled lineages descend from distinct introductions)
+     Marks 'lngNode' as SAMPLED at time 't' in 'locSample' for 'schemes' and
+     flags its ancestors, up to the first one flagged already (hence each
+     node is flagged once, whatever the depth of the sampled ancestry).
+     Returns 'false' if it had been sampled in all of 'schemes' already.
      
      */
     
-    std::vector<LineageTreeNode<T,U>*> subSampleTree()  {
+    bool sampleNode( NodeHandle lngNode, const double& t, LocationID locSample, SchemeSet schemes ) {
         
-        // loop over root nodes
-        std::vector<LineageTreeNode<T,U>*> res = {} ;
-        for ( LineageTreeNode<T,U>* rootNode : roots ) {
-            
-            // find sampled lngs descending from root
-            std::vector<T> selectedLngs = getSampledLineages( rootNode );
-            
-            uint nSampledLngs = static_cast<uint>( selectedLngs.size() ) ;
-            
-            if ( nSampledLngs > 0 ) {
-                
-                // extract subtree..
-                markNodeNeeded( rootNode, selectedLngs ) ;
-                LineageTreeNode<T, U>* subTreeRoot = extractSubTree( rootNode, nullptr ) ;
-                subTreeRoot = eliminateRedundantNodes( subTreeRoot, selectedLngs ) ;
-                //printEdgesFromNode( subTreeRoot ) ;
-
-                res.push_back( subTreeRoot ) ;
-                
+        Hot& node = nodes.hot( lngNode ) ;
+        Cold& info = nodes.cold( lngNode ) ;
+        if ( node.sampled ) { // lng has already been sampled: only adds new schemes, if any
+            uint32_t added = schemes.bits() & ~info.schemes ;
+            info.schemes |= added ;
+            return added != 0 ;
+        }
+        
+        node.sampled = true ;
+        info.schemes = schemes.bits() ;
+        info.tSample = t ;
+        info.locSample = locSample ;
+        
+        if ( !samplesByTime.empty() and t < samplesByTime.back().tSample ) // sorted again at the next query
+            samplesSorted = false ;
+        samplesByTime.push_back( { t, lngNode } ) ;
+        
+        invalidateSnapshots( lngNode ) ;
+        
+        NodeHandle h = lngNode ;
+        while ( !nodes.hot( h ).hasSampled ) { // flag ancestors
+            nodes.hot( h ).hasSampled = true ;
+            if ( nodes.hot( h ).parent == NULL_NODE ) { // first sample of the chain
+                roots.markSampled( nodes.hot( h ).slot ) ;
+                break ;
             }
-
+            h = nodes.hot( h ).parent ;
         }
         
-        return res ;
+        return true ;
         
     } ;
-
+    
     /*
      
-     Returns the ROOT node of the tree containing 'lngNode'.
-     
-     N.B. if 'lngNode' is ROOT, it returns itself.
+     Marks the reduced subtrees cached for 'node' and its ancestors (see
+     'takeSnapshot') as out of date, by setting their 'version' to the
+     current snapshot epoch. A node marked in this epoch already has its
+     ancestors marked too, hence the walk stops there: each node is marked
+     at most once between two snapshots. Nothing is cached before the
+     first snapshot, hence nothing is marked.
      
      */
     
-    LineageTreeNode<T,U>* getRootNode( LineageTreeNode<T,U>* lngNode )  {
+    void invalidateSnapshots( NodeHandle node ) {
         
-        if ( lngNode->parent == nullptr )
-            return lngNode ;
-        else
-            return getRootNode( lngNode->parent ) ;
+        if ( snapshotEpoch == 0 )
+            return ;
+        
+        for ( NodeHandle h = node; h != NULL_NODE and nodes.hot( h ).version != snapshotEpoch; h = nodes.hot( h ).parent )
+            nodes.hot( h ).version = snapshotEpoch ;
         
     } ;
-
+    
     /*
      
-     Returns the number of extant lineages.
+     Frees 'node' (and the reduced subtree cached for it, if any).
      
      */
     
-    uint getSizeExtantLineages() {
+    void releaseNode( NodeHandle node ) {
         
-        return static_cast<uint>( extantLngs.size() ) ;
+        TREE_STATS_UPDATE( ++stats.nodesFreed ; )
         
-    }
+        if ( node < snapshotCache.size() )
+            snapshotCache[node].rep.reset() ;
+        
+        nodes.hot( node ).released = true ;
+        nodes.release( node ) ;
+        --nnodes ;
+        
+    } ;
     
     /*
      
-     Returns the number of nodes.
+     Appends 'child' to the children of 'parent'.
      
      */
     
-    uint getSizeNodes() { return nnodes ; }
+    void attachChild( NodeHandle parent, NodeHandle child ) {
+        
+        ChildList& children = nodes.hot( parent ).children ;
+        nodes.hot( child ).slot = children.size() ;
+        children.push_back( child ) ;
+        
+    } ;
     
-private:
-    uint nnodes ;
-    std::unordered_map<T, LineageTreeNode<T,U>*, Hash > extantLngs ; // list of extant lineages
-    std::unordered_set<LineageTreeNode<T,U>*> roots ; // list of roots, i.e. trees
-    std::unordered_set<T> sampled_lineages ;
-    //std::unordered_map<LineageTreeNode<T,U>*, std::pair<LineageTreeNode<T,U>*, double>> parent_info ;
+    /*
+     
+     Removes 'child' from the children of 'parent' in O(1): the last child
+     takes its slot (does not perform further updates though).
+     
+     */
+    
+    void detachChild( NodeHandle parent, NodeHandle child ) {
+        
+        ChildList& children = nodes.hot( parent ).children ;
+        uint32_t slot = nodes.hot( child ).slot ;
+        assert( children[slot] == child ) ;
+        assert( !nodes.hot( child ).hasSampled ) ; // sampled nodes are never pruned
+        
+        NodeHandle last = children.back() ;
+        children[slot] = last ;
+        nodes.hot( last ).slot = slot ;
+        children.pop_back() ;
+        
+    } ;
     
     /*
           
      Notifies 'parent' lineage that 'child' lineage went extinct.
-     Uses a recursive strategy to broadcast the signal.
+     The signal is broadcast upstream iteratively (one ancestor per step).
      Here 'parent' is the current node.
      
      Decides whether 'parent' is made redundant after removing 'child'.
@@ -406,7 +2801,7 @@ private:
      - If 'parent' is EXTINCT but SAMPLED, stop (it cannot be removed).
      - If 'parent' is EXTINCT but NOT SAMPLED, check how many children M.
         + If M = 0 (no children), check if grandparent node is ROOT:
-            > if NOT ROOT, notify grandparent.
+            > if NOT ROOT, notify grandparent (next step).
             > if ROOT, remove from root list.
             > In either case, free memory & update 'nnodes'.
         + if M = 1 (exactly one child), make merge move ('mergeParentChild').
@@ -421,52 +2816,46 @@ private:
             b. If only one child, do merge move
             c. Else, do nothing
      
+     Removed nodes are freed once the signal has stopped, topmost first
+     (the order in which they are recycled by later allocations).
+     
      */
     
-    void notifyParent( LineageTreeNode<T,U>* parent, LineageTreeNode<T,U>* child, bool ignore_sampled = false ) {
+    void notifyParent( NodeHandle parent, NodeHandle child, bool /* ignore_sampled */ = false ) {
         
-        bool parentExtinct = !parent->extant   ;
-        bool parentSampled = parent->sampled   ;
-        bool childSampled  = child->sampled    ;
-        
-        if ( !childSampled ) { // erase child only if unsampled
-            // this should be a full removal
-            //parent->children_branching_times.erase( child->lng ) ;
-            parent->eraseChild( child ) ;
-        }
+        TREE_STATS_UPDATE( std::size_t depth = 0 ; )
         
-        if ( parentExtinct ) { // parent is extinct, check if it was also sampled
+        while ( parent != NULL_NODE ) {
             
-            /*
-            bool proceed = true ;
-            if ( parentSampled )
-                proceed = false ;*/
+            TREE_STATS_UPDATE( ++depth ; )
             
-            if ( !parentSampled ) {
-                
-                // parent was not sampled
+            Hot& parentNode = nodes.hot( parent ) ;
+            NodeHandle grandparent = NULL_NODE ; // next node to notify (if any)
+            
+            bool parentExtinct = !parentNode.extant   ;
+            bool parentSampled = parentNode.sampled   ;
+            bool childSampled  = nodes.hot( child ).sampled ;
+            
+            if ( !childSampled ) { // erase child only if unsampled
+                // this should be a full removal
+                //parent->children_branching_times.erase( child->lng ) ;
+                detachChild( parent, child ) ;
+            }
+            
+            if ( parentExtinct and !parentSampled ) { // parent is extinct and was not sampled
                 
-                uint nChildren = parent->getSizeChildren() ;
+                uint nChildren = parentNode.children.size() ;
                 
                 if ( nChildren == 0 ) {
                     
                     // after removing child, parent is a redundant extinct leaf: remove it
-                    bool parentRoot = parent->parent == nullptr ; //
-                    if ( !parentRoot ) {
-                        
-                        // notify grandparent
-                        notifyParent( parent->parent, parent, ignore_sampled ) ;
-                        
-                    }
-                    else {
-                        
-                        // parent is also root: remove from root list
-                        roots.erase( parent ) ;
-                        
-                    }
+                    bool parentRoot = parentNode.parent == NULL_NODE ; //
+                    if ( !parentRoot )
+                        grandparent = parentNode.parent ; // notify grandparent
+                    else
+                        roots.remove( parentNode.slot ) ; // parent is also root: remove from root list
                     
-                    delete parent ; // free memory
-                    --nnodes ;
+                    pendingRelease.push_back( parent ) ; // free memory once grandparent is done with it
             
                 }
                 else if ( nChildren == 1 ) {
@@ -478,6 +2867,22 @@ private:
 
             }
             
+            child = parent ;
+            parent = grandparent ;
+            
+        }
+        
+        TREE_STATS_UPDATE(
+            if ( depth >= stats.cascadeDepths.size() )
+                stats.cascadeDepths.resize( depth + 1, 0 ) ;
+            ++stats.cascadeDepths[depth] ;
+        )
+        
+        while ( !pendingRelease.empty() ) {
+            
+            releaseNode( pendingRelease.back() ) ;
+            pendingRelease.pop_back() ;
+            
         }
             
     } ;
@@ -498,341 +2903,275 @@ private:
      
      */
     
-    void mergeParentChild( LineageTreeNode<T,U>* midNode )  {
+    void mergeParentChild( NodeHandle midNode )  {
+        
+        TREE_STATS_UPDATE( ++stats.merges ; )
         
-        assert( midNode->children.size() == 1 ) ;
-        assert( !midNode->extant ) ;
+        Hot& mid = nodes.hot( midNode ) ;
         
-        if ( midNode->parent != nullptr ) { // midNode is an intermediate node O->X->O
+        assert( mid.children.size() == 1 ) ;
+        assert( !mid.extant ) ;
+        
+        NodeHandle childNode = mid.children[0] ;
+        Hot& child = nodes.hot( childNode ) ;
+        assert( child.hasSampled == mid.hasSampled ) ; // mid is not sampled, hence flags upstream are unchanged
+        
+        if ( mid.parent != NULL_NODE ) { // midNode is an intermediate node O->X->O
             
-            midNode->children[0]->parent = midNode->parent ;
-            midNode->parent->eraseChild( midNode ) ;
-            midNode->parent->children.push_back( midNode->children[0] ) ;
+            child.parent = mid.parent ;
+            child.slot = mid.slot ;
+            nodes.hot( mid.parent ).children[ mid.slot ] = childNode ; // child takes the place of midNode
             //midNode->parent->children_branching_times[ midNode->children[0]->lng ] = midNode->parent->children_branching_times[ midNode->lng ] ;
             //midNode->parent->children_branching_times.erase( midNode->lng ) ;
 
-            midNode->children[0]->tBranchParent = midNode->tBranchParent ;
+            child.tBranchParent = mid.tBranchParent ;
             
         }
         else { // midNode is a root with a single child @->X->O, hence child becomes root
             
-            midNode->children[0]->parent = nullptr ;
-            roots.erase( midNode ) ;
-            roots.insert( midNode->children[0] ) ;
+            child.parent = NULL_NODE ;
+            child.slot = mid.slot ;
+            roots.replace( mid.slot, childNode ) ; // child takes the place of midNode in its chain
             //midNode->children_branching_times.erase( midNode->lng ) ;
-            midNode->children[0]->tBranchParent = midNode->children[0]->t ; // This should be OK because branching time is irrelevant for roots
+            child.tBranchParent = nodes.cold( childNode ).t ; // This should be OK because branching time is irrelevant for roots
         
         }
         
-        delete midNode ;
-        --nnodes ;
+        releaseNode( midNode ) ;
         
     } ;
     
     
     /*
      
-     // ??? Revise the description
-     
-     This is a recursive function that when called on a root node of a transmission tree,
-     yields the subtree containing only nodes marked as 'needed' (i.e. nodes that had been
-     sampled or that are instrumental to reconstruct ancestral relationships between sampled
-     lineage).
-     
-     The function is called on the 'node' of the original transmission tree, while 'parent' is
-     a copy of node->parent in the subtree.
-     
-     Extracts subtree using the 'needed' attribute.
-     
-     Starting from a current tree node ('node') and attach node to 'parent', which is a newly created node
-     that builds the output, the subsampled tree
-     
-     */
-    
-    LineageTreeNode<T,U>* extractSubTree( LineageTreeNode<T,U>* node, LineageTreeNode<T,U>* parent ) {
-        
-        assert( node != nullptr ) ;
-        
-        // copy original node into new node (output)
-        LineageTreeNode<T,U>* newNode = new LineageTreeNode<T,U>( node->lng, node->data, node->t, node->extant, parent ) ;
-        
-        // Add rest of sampling information
-        newNode->sampled   = node->sampled ;
-        newNode->tSample   = node->tSample ;
-        newNode->locSample = node->locSample ;
-        newNode->tBranchParent = node->tBranchParent ;
-        //newNode->children_branching_times = {} ;
-
-        for ( auto& child : node->children ) {
-            
-            if ( child->needed ) {
-                
-                LineageTreeNode<T,U>* newChild = extractSubTree( child, newNode ) ;
-                ( newNode->children ).push_back( newChild ) ;
-                //newNode->children_branching_times[ child->lng ] = node->children_branching_times[ child->lng ] ;
-                
-            }
-            
-        }
-        
-        return newNode ;
-        
-    } ;
-    
-    /*
+     Yields the reduced transmission tree of the tree rooted at 'rootNode'
+     ('nullptr' if none of its lineages was sampled).
      
-     Recursively fills 'lngs' vector with SAMPLED lineages.
+     Nodes are visited in post-order. Each node passes upstream the reduced
+     copies ('representatives') of its descendants, which depends on the
+     number K of representatives received from its children:
      
-     If 'node' is SAMPLED, store it back. Then move to its children.
+        - If SAMPLED or K > 1, the node is needed: copy it and attach the
+          K representatives as children. The copy is its representative.
+        - If NOT SAMPLED and K = 1, the node is redundant: pass on the only
+          representative, which now branches at the time the node did
+          ('tBranchParent'), or becomes root if the node was root.
+        - If NOT SAMPLED and K = 0, the node is not needed at all.
      
-     */
-    void getSampledLineagesRecursive( LineageTreeNode<T,U>* node, std::vector<T>& lngs ) {
-        
-        if ( node->sampled ) // if sampled, add node to vector
-            lngs.push_back( node->lng ) ;
-        
-        for ( auto child : node->children )
-            getSampledLineagesRecursive( child, lngs ) ;
-        
-    } ;
-
-    
-    /*
+     Only nodes of the reduced tree are copied and no search over sampled
+     lineages is involved. Subtrees without sampled nodes ('hasSampled' unset)
+     are not visited.
      
-     Set 'node' to 'needed' if it should be included in the reduced transmission tree.
+     If 'isRoot' is 'false', 'rootNode' is reduced as an inner node (its only
+     representative keeps the branching time of 'rootNode'). Subtrees listed
+     in 'cuts' are not visited: their representatives (reduced beforehand,
+     as inner nodes) are used instead (see 'subSampleTree( nthreads )').
      
-     This function is used recursively: returns whether 'node' is 'needed' or not.
-     At the same time it fills the vector 'neededLngs' with SAMPLED nodes and some of their
-     ancestors.
+     'filter' selects the tips of the reduced tree among sampled nodes
+     (see 'AllSampled'); other sampled nodes are treated as unsampled.
      
      */
     
-    bool markNodeNeeded( LineageTreeNode<T,U>* node, const std::vector<T>& neededLngs ) {
+    template <class Filter = AllSampled>
+    LineageTreeNode<T,U,Hash>* reduceSubTree( NodeHandle rootNode, bool isRoot = true, const FlatHashMap<NodeHandle, LineageTreeNode<T,U,Hash>*>* cuts = nullptr, const Filter& filter = Filter() ) const {
         
-        if ( node->extant ) { // is extant
+        struct Reducer {
             
-            bool needed = false ;
-            for ( const auto& ll : neededLngs ) {
+            const Pool& nodes ;
+            const Filter& filter ;
+            NodeHandle top ;
+            bool isRoot ; // whether 'top' becomes a root
+            const FlatHashMap<NodeHandle, LineageTreeNode<T,U,Hash>*>* cuts ;
+            std::vector<LineageTreeNode<T,U,Hash>*> reps ; // representatives of visited subtrees
+            std::vector<std::size_t> marks ; // size of 'reps' when entering each node of the current path
+            bool skipped ; // true if the last node entered was not visited
+            
+            bool enter( NodeHandle nodeHandle ) {
                 
-                if ( ll == node->lng ) {
-                    
-                    needed = true ;
-                    break ;
-                    
+                skipped = true ;
+                if ( !filter.visit( nodes, nodeHandle ) ) // skip subtrees without sampled nodes (selected by 'filter')
+                    return false ;
+                
+                if ( cuts != nullptr and nodeHandle != top ) {
+                    LineageTreeNode<T,U,Hash>* const* rep = cuts->find( nodeHandle ) ;
+                    if ( rep != nullptr ) { // reduced already
+                        if ( *rep != nullptr )
+                            reps.push_back( *rep ) ;
+                        return false ;
+                    }
                 }
-            
+                
+                skipped = false ;
+                marks.push_back( reps.size() ) ;
+                return true ;
+                
             }
             
-            if ( node->sampled ) // if sampled previously
-                needed = true ;
-            
-            if ( needed ) {
-                node->needed = true ;
-                for ( auto& child : node->children )
-                    markNodeNeeded( child, neededLngs ) ;
-            }
-            else { // if not sampled directly
+            void leave( NodeHandle nodeHandle ) {
                 
-                for ( auto& child : node->children ) {
-                    
-                    bool isChildNeeded = markNodeNeeded( child, neededLngs ) ;
-                    node->needed = ( node->needed or isChildNeeded ) ;
-                    
+                if ( skipped ) { // left right after 'enter' returned false
+                    skipped = false ;
+                    return ;
                 }
                 
-            }
-            
-            return node->needed ;
-        
-        }
-        else { // is not extant, check if needed due to children or if sampled
-            
-            node->needed = false ;
-            
-            if ( node->sampled )
-                node->needed = true ;
-            
-            for ( auto& child : node->children ) {
+                const Hot& node = nodes.hot( nodeHandle ) ;
+                bool sampled = node.sampled and filter.tip( nodes, nodeHandle ) ;
                 
-                bool isChildNeeded = markNodeNeeded( child, neededLngs ) ;
-                node->needed = ( node->needed or isChildNeeded ) ;
+                std::size_t first = marks.back() ;
+                std::size_t nReps = reps.size() - first ; // representatives from children
+                marks.pop_back() ;
                 
-            }
-            
-        }
-        
-        return node->needed ;
-        
-    } ;
-
-    /*
-     
-     Helper function to print a transmission tree, edge by edge.
-     
-     */
-    /*
-    void printParentChildEdge( LineageTreeNode<T,U>* child, bool recursive = true )  {
-        
-        std::string stringParent = "@";
-        if ( child->parent != nullptr )
-            stringParent = utils::to_string( child->parent->lng ) ;
-            
-        std::cout << stringParent << "->" << utils::to_string( child->lng )<< "\n";
-        
-        if ( recursive and child->parent != nullptr )
-            printParentChildEdge( child->parent, true ) ;
-        
-    } ;*/
-
-    
-    
-} ;
-
-//====== LineageTreeNode helper functions ======//
-
-
-/*
- 
- Prunes a LineageTreeNode<T,U> transmission tree with 'root' as root node,
- using a vector 'sampledLngs' of lineages.
- 
- Returns the reduced transmission tree.
- 
- */
-
-template <typename T, typename U>
-LineageTreeNode<T,U>* eliminateRedundantNodes( LineageTreeNode<T,U>* root, const std::vector<T>& sampledLngs ) {
-    
-    // find leaves
-    std::unordered_set<LineageTreeNode<T,U>*> leaves = {} ;
-    leaves.reserve( sampledLngs.size() ) ;
-
-    findLeaves( leaves, root ) ; // find leaves
-    
-    // starting from each leaf, recurse back to root and remove intermediate leaves
-    for ( auto leaf : leaves )
-        removeRedundantNodeMerge( leaf->parent, sampledLngs );
-        
-    return findRoot( *( leaves.begin() ) ) ; // return tree as the root of the first sampled lineage.
-    
-} ;
-
-/*
- 
- Returns the root of the tree starting from 'lngNode'.
- 
- N.B. This could be 'lngNode' itself if it is a root node.
- 
- */
-
-template <typename T, typename U>
-LineageTreeNode<T,U>* findRoot( LineageTreeNode<T,U>* lngNode ) {
-    
-    if ( lngNode->parent == nullptr )
-        return lngNode ;
-    else
-        return findRoot( lngNode->parent ) ;
-    
-}
-
-/*
- 
- Fills the vector 'leaves' with EXTREMAL lineages descending from 'node'.
- 
- If 'node' is a root node, it fills 'leaves' with all EXTREMAL lineages.
- 
- */
-
-template <typename T, typename U>
-void findLeaves( std::unordered_set<LineageTreeNode<T,U>*>& leaves, LineageTreeNode<T,U>* node ) {
-    
-    if ( node->children.size() == 0 ) {
-        
-        //if ( node->parent != nullptr ) // root node can not be leaf
-        leaves.insert( node ) ; // root node can be a leaf if it is the only node
+                if ( sampled or nReps > 1 ) { // needed: copy node
+                    
+                    const Cold& info = nodes.cold( nodeHandle ) ;
+                    LineageTreeNode<T,U,Hash>* newNode = new LineageTreeNode<T,U,Hash>( info.lng, info.data, info.t, node.extant, nullptr ) ;
+                    newNode->sampled   = sampled ;
+                    newNode->tSample   = info.tSample ;
+                    newNode->locSample = info.locSample ;
+                    newNode->tBranchParent = node.tBranchParent ;
+                    
+                    newNode->children.assign( reps.begin() + first, reps.end() ) ;
+                    for ( LineageTreeNode<T,U,Hash>* child : newNode->children )
+                        child->parent = newNode ;
+                    
+                    reps.resize( first ) ;
+                    reps.push_back( newNode ) ;
+                    
+                }
+                else if ( nReps == 1 ) { // redundant mid node: merge
+                    
+                    LineageTreeNode<T,U,Hash>* child = reps.back() ;
+                    if ( nodeHandle != top or !isRoot )
+                        child->tBranchParent = node.tBranchParent ;
+                    else
+                        child->tBranchParent = child->t ; // This should be OK because branching time is irrelevant for roots
+                    
+                }
+                // else not needed
+                
+            }
+            
+        } reducer{ nodes, filter, rootNode, isRoot, cuts, {}, {}, false } ;
         
-    }
-    else {
+        traverseDepthFirst( rootNode, TrackingChildren{ nodes }, reducer ) ;
         
-        for ( auto child : node->children )
-            findLeaves( leaves, child ) ;
+        return reducer.reps.empty() ? nullptr : reducer.reps.back() ;
         
-    }
-    
-}
-
-/*
- 
- Helper function that removes 'midNode' in a transmission tree if it is
- found to be redundant given a vector 'sampledLngs' with all sampled lineages.
- 
- See also 'eliminateRedundantNodes'.
- 
- */
-
-template <typename T, typename U>
-void removeRedundantNodeMerge( LineageTreeNode<T,U>* midNode, const std::vector<T>& sampledLngs ) {
-    
-    if ( !midNode )
-        return ;
+    } ;
     
-    if ( midNode->children.size() == 1 ) { // may merge if has one child only
+    /*
+     
+     Snapshot counterpart of 'reduceSubTree': yields the immutable reduced
+     subtree of 'rootNode' (same rules), reusing cached subtrees of nodes
+     not marked out of date since they were built (i.e. in an earlier epoch
+     than 'epoch', see 'invalidateSnapshots').
+     
+     */
     
-        // check if node is sampled
-        bool isSampled = false ;
-        for ( auto& lng : sampledLngs ) {
+    std::shared_ptr<const SnapshotNode<T,U>> snapshotSubTree( NodeHandle rootNode ) {
+        
+        typedef typename SnapshotNode<T,U>::Edge Edge ;
+        
+        struct Snapshotter {
             
-            if ( lng == midNode->lng ) {
+            const Pool& nodes ;
+            std::vector<SnapshotCacheEntry>& cache ;
+            uint32_t epoch ; // current snapshot epoch
+            std::vector<Edge> reps ; // representatives of visited subtrees (with branching times)
+            std::vector<std::size_t> marks ; // size of 'reps' when entering each node of the current path
+            bool skipped ; // true if the last node entered was not descended into
             
-                isSampled = true ;
-                break ;
+            bool isCached( NodeHandle h ) const { return h < cache.size() and cache[h].rep and nodes.hot( h ).version < cache[h].epoch ; }
             
+            bool enter( NodeHandle h ) {
+                
+                skipped = true ;
+                
+                if ( !nodes.hot( h ).hasSampled ) // skip subtrees without sampled nodes
+                    return false ;
+                
+                if ( isCached( h ) ) { // unchanged since last snapshot: share it
+                    reps.push_back( Edge{ nodes.hot( h ).tBranchParent, cache[h].rep } ) ;
+                    return false ;
+                }
+                
+                skipped = false ;
+                marks.push_back( reps.size() ) ;
+                return true ;
+                
             }
-        
-        }
-        if ( !isSampled ) {  // if not sampled, remove
             
-            if ( midNode->parent == nullptr ) { // if parent is root
+            void leave( NodeHandle h ) {
                 
-                // promote only child to root
-                midNode->children[0]->parent = nullptr ;
-                midNode->children[0]->tBranchParent = midNode->children[0]->t ; // this should be OK given that tBranchParent is irrelevant for roots
+                if ( skipped ) { // 'leave' directly follows 'enter' for skipped nodes
+                    skipped = false ;
+                    return ;
+                }
                 
-            }
-            else {
+                const Hot& node = nodes.hot( h ) ;
                 
-                midNode->children[0]->parent = midNode->parent ;
-                midNode->parent->eraseChild( midNode ) ;
-                midNode->parent->children.push_back( midNode->children[0] ) ;
-
-                //midNode->parent->children_branching_times[ midNode->children[0]->lng ] = midNode->parent->children_branching_times[ midNode->lng ] ;
-                //midNode->parent->children_branching_times.erase( midNode->lng ) ;
-                midNode->children[0]->tBranchParent = midNode->tBranchParent ;
-                removeRedundantNodeMerge( midNode->parent, sampledLngs ) ;
+                std::size_t first = marks.back() ;
+                std::size_t nReps = reps.size() - first ;
+                marks.pop_back() ;
                 
+                if ( node.sampled or nReps > 1 ) { // needed: new node
+                    
+                    std::shared_ptr<SnapshotNode<T,U>> newNode = std::make_shared<SnapshotNode<T,U>>() ;
+                    const Cold& info = nodes.cold( h ) ;
+                    newNode->t = info.t ;
+                    newNode->tSample = info.tSample ;
+                    newNode->locSample = info.locSample ;
+                    newNode->lng = info.lng ;
+                    newNode->data = info.data ;
+                    newNode->extant = node.extant ;
+                    newNode->sampled = node.sampled ;
+                    newNode->children.assign( reps.begin() + first, reps.end() ) ;
+                    
+                    reps.resize( first ) ;
+                    reps.push_back( Edge{ node.tBranchParent, newNode } ) ;
+                    
+                }
+                else // redundant mid node: pass on the only representative, branching when the node did
+                    reps.back().tBranchParent = node.tBranchParent ;
+                
+                if ( h >= cache.size() )
+                    cache.resize( nodes.endHandle() ) ;
+                cache[h].epoch = epoch ;
+                cache[h].rep = reps.back().node ;
                 
             }
             
-            delete midNode ;
-            
-        }
-        else { // recurse up
-            
-            if ( midNode->parent != nullptr ) // recurse up until root
-                removeRedundantNodeMerge( midNode->parent, sampledLngs ) ;
-            
-        }
+        } snapshotter{ nodes, snapshotCache, snapshotEpoch, {}, {}, false } ;
         
-    }
-    else { // recurse up
+        traverseDepthFirst( rootNode, TrackingChildren{ nodes }, snapshotter ) ;
         
-        if ( midNode->parent != nullptr ) // recurse up until root
-            removeRedundantNodeMerge( midNode->parent, sampledLngs ) ;
+        assert( snapshotter.reps.size() == 1 ) ; // 'rootNode' has sampled lineages
+        return snapshotter.reps.back().node ;
         
-    }
+    } ;
     
-}
+    /*
+     
+     Helper function to print a transmission tree, edge by edge.
+     
+     */
+    /*
+    void printParentChildEdge( LineageTreeNode<T,U,Hash>* child, bool recursive = true )  {
+        
+        std::string stringParent = "@";
+        if ( child->parent != nullptr )
+            stringParent = utils::to_string( child->parent->lng ) ;
+            
+        std::cout << stringParent << "->" << utils::to_string( child->lng )<< "\n";
+        
+        if ( recursive and child->parent != nullptr )
+            printParentChildEdge( child->parent, true ) ;
+        
+    } ;*/
 
+    
+    
+} ;
 
 //====== PhyloNode ======//
 
@@ -852,7 +3191,7 @@ void removeRedundantNodeMerge( LineageTreeNode<T,U>* midNode, const std::vector<
 template <typename T, typename U>
 struct PhyloNode {
     
-    PhyloNode( const T& lng, PhyloNode* parent = nullptr  ): lng( lng ), leftChild( nullptr ), rightChild( nullptr ), parent( parent ), depth( 0 ), depthChild( 0 ), depthAttachSampledNode( -1 ), t( 0 ), dt( 0 ), locSample( "NA" ) {} ;
+    PhyloNode( const T& lng, PhyloNode* parent = nullptr  ): lng( lng ), leftChild( nullptr ), rightChild( nullptr ), parent( parent ), depth( 0 ), depthChild( 0 ), depthAttachSampledNode( -1 ), t( 0 ), dt( 0 ), locSample( LOCATION_NA ) {} ;
     PhyloNode* leftChild ;
     PhyloNode* rightChild ;
     PhyloNode* parent ;
@@ -861,7 +3200,7 @@ struct PhyloNode {
     uint depthAttachSampledNode ; // initialised to -1, used to track where sampled ancestors must be placed
     double t ; // node time (infection time if internal, sampling time if leaf)
     double dt ; // branch length (wrt parent)
-    std::string locSample ; // sampling location (if any; default is NA)
+    LocationID locSample ; // sampling location (if any; default is NA, see 'LocationDictionary')
     T lng ;  // lineage identity
     U data ; // extra data
     friend std::ostream& operator<<(std::ostream& os, const PhyloNode<T,U>*& dt);
@@ -870,6 +3209,20 @@ struct PhyloNode {
 
 
 
+/*
+ Children accessor of PhyloNode<T,U> trees (see 'traverseDepthFirst').
+ */
+
+struct PhyloNodeChildren {
+    
+    template <typename T, typename U>
+    std::size_t nChildren( PhyloNode<T,U>* node ) const { return ( node->leftChild != nullptr ) + ( node->rightChild != nullptr ) ; }
+    
+    template <typename T, typename U>
+    PhyloNode<T,U>* child( PhyloNode<T,U>* node, std::size_t i ) const { return ( i == 0 and node->leftChild != nullptr ) ? node->leftChild : node->rightChild ; }
+    
+} ;
+
 /*
  
  Frees memory initially allocated to a tree composed of PhyloNode<T,U>.
@@ -879,15 +3232,62 @@ struct PhyloNode {
 template <typename T, typename U>
 void deletePhyloNodeTree( PhyloNode<T,U>* root ) {
     
-    if ( root->leftChild != nullptr )
-        deletePhyloNodeTree( root->leftChild ) ;
+    visitPostOrder( root, PhyloNodeChildren(), []( PhyloNode<T,U>* node ) { delete node ; } ) ;
+    
+}
+
+/*
+ 
+ Owner of a phylogenetic tree (e.g. the result of 'getAncestralTree'),
+ which is freed when it goes out of scope (see 'ReducedForest').
+ 
+ */
+
+template <typename T, typename U>
+class PhyloTree {
+public:
     
-    if ( root->rightChild != nullptr )
-        deletePhyloNodeTree( root->rightChild ) ;
+    explicit PhyloTree( PhyloNode<T,U>* root = nullptr ): root( root ) {} ;
+    PhyloTree( PhyloTree&& other ) noexcept : root( other.root ) { other.root = nullptr ; } ;
+    ~PhyloTree() { reset() ; } ;
     
-    delete root ;
+    PhyloTree( const PhyloTree& ) = delete ;
+    PhyloTree& operator=( const PhyloTree& ) = delete ;
     
-}
+    PhyloTree& operator=( PhyloTree&& other ) noexcept {
+        
+        if ( this != &other ) {
+            reset() ;
+            std::swap( root, other.root ) ;
+        }
+        return *this ;
+        
+    }
+    
+    PhyloNode<T,U>* get() const { return root ; }
+    PhyloNode<T,U>* operator->() const { return root ; }
+    explicit operator bool() const { return root != nullptr ; }
+    
+    void reset( PhyloNode<T,U>* newRoot = nullptr ) { // frees the current tree
+        
+        if ( root != nullptr )
+            deletePhyloNodeTree( root ) ;
+        root = newRoot ;
+        
+    }
+    
+    PhyloNode<T,U>* release() {
+        
+        PhyloNode<T,U>* res = root ;
+        root = nullptr ;
+        return res ;
+        
+    }
+    
+private:
+    PhyloNode<T,U>* root ;
+    
+} ;
 
 
 
@@ -895,46 +3295,57 @@ void deletePhyloNodeTree( PhyloNode<T,U>* root ) {
 
 /*
  
- Returns a phylogenetic tree from a reduced transmission tree.
+ Bookkeeping of a phylogenetic node while it is built (see 'ancestralStep'):
+ nodes of a chain of transmission events from the same source share the
+ same reduced node, and are told apart by their depth along the chain.
  
- 'node' can be any node in the reduced transmission tree, but
- the complete phylogenetic tree is returned by calling the
- function on the root node of the reduced transmission tree.
+ */
+
+template <typename T>
+struct AncestralState {
+    
+    const T* lng ; // lineage identity
+    uint depth ; // depth of internal nodes along a chain
+    uint depthChild ; // child index
+    uint depthAttachSampledNode ; // where sampled ancestors must be placed (-1 if not computed)
+    double t ; // node time
+    double dt ; // branch length (wrt parent)
+    
+} ;
+
+/*
  
- 'getAncestralTree' will be called recursively on downstream
- nodes.
+ One step of 'getAncestralTree', independent of how phylogenetic nodes are
+ stored: computes the state of the phylogenetic node of 'node' below the
+ node of state 'parent' ('nullptr' for the root).
  
- In the resulting tree, sampled lineages appear as leaf nodes,
- while internal nodes correspond to past infection events.
- However, it may also happen that some ancestral lineages are also leaves.
- This might happen if we manage to sample the parent of a lineage.
+ The reduced transmission nodes whose phylogenetic nodes must be
+ attached as left/right children of the new node are returned through
+ 'left' and 'right' (unchanged if none). Returns 'true' if instead a leaf
+ for the sampled ancestor 'node' must be attached as right child, with
+ branch length 'dtSampled' (and time 'node->tSample').
  
  */
 
+template <typename T, typename U, class Hash>
+bool ancestralStep( LineageTreeNode<T,U,Hash>* node, const AncestralState<T>* parent, AncestralState<T>& state, LineageTreeNode<T,U,Hash>*& left, LineageTreeNode<T,U,Hash>*& right, double& dtSampled ) {
 
-template <typename T, typename U>
-PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* phyloParent = nullptr ) {
-
-    if ( node == nullptr )
-        return nullptr ;
-        
-    bool isChild   = ( phyloParent == nullptr ) ? false : true ; // true : is child of some other node; false : is root node
+    bool isChild   = ( parent == nullptr ) ? false : true ; // true : is child of some other node; false : is root node
     bool isSampled = node->sampled ;
+    bool sampledLeaf = false ;
     
-    // create phylo node (internal or tip)
-    PhyloNode<T,U>* newNode = new PhyloNode<T,U>( node->lng, phyloParent ) ;
-    
-    // add data
-    newNode->data = node->data ;
-
     // calculate node depth and set depthChild
-    newNode->depth      = 0 ;
-    newNode->depthChild = 0 ;
+    state.lng        = &node->lng ;
+    state.depth      = 0 ;
+    state.depthChild = 0 ;
+    state.depthAttachSampledNode = static_cast<uint>( -1 ) ;
+    state.t  = 0. ;
+    state.dt = 0. ;
 
-    if ( isChild and ( newNode->lng == phyloParent->lng ) ) { // this child is part of a chain of transmission events from the same source
-        newNode->depth = phyloParent->depth + 1 ; // is incremented
-        newNode->depthChild = phyloParent->depthChild ; // must be incremented only when used
-        newNode->depthAttachSampledNode = phyloParent->depthAttachSampledNode ;
+    if ( isChild and ( node->lng == *parent->lng ) ) { // this child is part of a chain of transmission events from the same source
+        state.depth = parent->depth + 1 ; // is incremented
+        state.depthChild = parent->depthChild ; // must be incremented only when used
+        state.depthAttachSampledNode = parent->depthAttachSampledNode ;
 
     }
     
@@ -942,9 +3353,9 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
     auto& children_sorted = node->children ;
     uint nChildren = static_cast<uint>( children_sorted.size() ) ;
     
-    if ( ( nChildren > 1 ) and ( newNode->depth == 0 ) ) {
+    if ( ( nChildren > 1 ) and ( state.depth == 0 ) ) {
         
-        std::sort( children_sorted.begin(), children_sorted.end(), [&]( LineageTreeNode<T,U>*& node1, LineageTreeNode<T,U>* node2 ) {
+        std::sort( children_sorted.begin(), children_sorted.end(), [&]( LineageTreeNode<T,U,Hash>*& node1, LineageTreeNode<T,U,Hash>* node2 ) {
                 return node1->tBranchParent < node2->tBranchParent ;  // sort by time from the map
             } ) ;
     
@@ -953,13 +3364,12 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
     if ( nChildren == 0 ) { // sampled leaf with no children
         
         assert( isSampled ) ; // must be a leaf
-        newNode->t = node->tSample ;
-        if ( phyloParent == nullptr ) newNode->dt = 0 ;
+        state.t = node->tSample ;
+        if ( parent == nullptr ) state.dt = 0 ;
         else {
-            newNode->dt = newNode->t - phyloParent->t ;
-            assert( newNode->t >= phyloParent->t ) ;
+            state.dt = state.t - parent->t ;
+            assert( state.t >= parent->t ) ;
         }
-        newNode->locSample = node->locSample ; // only for sampled nodes
         
     }
     else { // has some children: this leaf is also an ancestor for some other nodes (sampled ancestor)
@@ -970,15 +3380,15 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
             
             // calculate (ONLY ONCE when depth = 0) where node should be placed
             
-            if ( newNode->depth == 0 ) { // calculate only once
+            if ( state.depth == 0 ) { // calculate only once
                 
-                newNode->depthAttachSampledNode = 0 ; // position where sampled lineage should be placed
+                state.depthAttachSampledNode = 0 ; // position where sampled lineage should be placed
                 for ( auto& child : children_sorted ) {
                     
                     if ( tSample < child->tBranchParent ) // stop before sampling time exceeds branching time
                         break ;
                     else
-                        newNode->depthAttachSampledNode++ ;
+                        state.depthAttachSampledNode++ ;
 
                 }
                 
@@ -987,66 +3397,59 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
                 
             }
                         
-            if ( newNode->depthAttachSampledNode < nChildren ) { // node is sampled before some children are created
+            if ( state.depthAttachSampledNode < nChildren ) { // node is sampled before some children are created
                 
-                if ( newNode->depth == newNode->depthAttachSampledNode ) { // attach sampled node
+                if ( state.depth == state.depthAttachSampledNode ) { // attach sampled node
                     
-                    newNode->t = tSample ;
-                    if ( phyloParent == nullptr ) {
-                        newNode->dt = 0. ;
+                    state.t = tSample ;
+                    if ( parent == nullptr ) {
+                        state.dt = 0. ;
                     }
                     else {
-                        newNode->dt = newNode->t - phyloParent->t ;
-                        assert( newNode->t >= phyloParent->t ) ;
+                        state.dt = state.t - parent->t ;
+                        assert( state.t >= parent->t ) ;
                     }
                     
-                    PhyloNode<T,U>* sampledNode = new PhyloNode<T,U>( node->lng, newNode ) ;
-                    sampledNode->t = node->tSample ;
-                    sampledNode->dt = 0. ; // Sampled ancestor has 0 branch length..
-                    sampledNode->depth = newNode->depth + 1 ;
-                    sampledNode->data = node->data ;
-                    sampledNode->locSample = node->locSample ; // only for sampled nodes
-                    sampledNode->leftChild = nullptr ;
-                    sampledNode->rightChild = nullptr ;
-                    newNode->rightChild = sampledNode ;
+                    sampledLeaf = true ;
+                    dtSampled = 0. ; // Sampled ancestor has 0 branch length..
                     
-                    if ( newNode->depthChild == nChildren - 1  ) {
-                        auto& child = children_sorted[ newNode->depthChild ] ;
-                        newNode->depthChild += 1 ;
-                        newNode->leftChild = getAncestralTree( child, newNode ) ;
+                    if ( state.depthChild == nChildren - 1  ) {
+                        auto& child = children_sorted[ state.depthChild ] ;
+                        state.depthChild += 1 ;
+                        left = child ;
                     }
                     else {
-                        newNode->leftChild = getAncestralTree( node, newNode ) ;
+                        left = node ;
                     }
 
                 
                 }
                 else { // attach child + internal node (or two nodes)
                     
-                    auto& child = children_sorted[ newNode->depthChild ] ;
-                    newNode->t = child->tBranchParent ;
-                    newNode->depthChild += 1 ;
+                    auto& child = children_sorted[ state.depthChild ] ;
+                    state.t = child->tBranchParent ;
+                    state.depthChild += 1 ;
                     
-                    if ( phyloParent == nullptr ) {
-                        newNode->dt = 0 ;
+                    if ( parent == nullptr ) {
+                        state.dt = 0 ;
                     }
                     else {
-                        newNode->dt = newNode->t - phyloParent->t ;
-                        assert( newNode->t >= phyloParent->t ) ;
+                        state.dt = state.t - parent->t ;
+                        assert( state.t >= parent->t ) ;
                     }
                     
-                    newNode->leftChild = getAncestralTree( child, newNode ) ;
+                    left = child ;
                     
                     
-                    if (  newNode->depth == nChildren - 1 ) {
+                    if (  state.depth == nChildren - 1 ) {
                         
-                        auto& child2 = children_sorted[ newNode->depthChild ] ;
-                        newNode->rightChild = getAncestralTree( child2,  newNode ) ;
+                        auto& child2 = children_sorted[ state.depthChild ] ;
+                        right = child2 ;
                         
                     }
                     else {
                         
-                        newNode->rightChild = getAncestralTree( node,  newNode ) ;
+                        right = node ;
                         
                     }
                     
@@ -1055,38 +3458,31 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
             }
             else { // node is sampled after all children are created
                 
-                newNode->t = children_sorted[ newNode->depth ]->tBranchParent ;
-                if ( phyloParent == nullptr ) {
-                    newNode->dt = 0 ;
+                state.t = children_sorted[ state.depth ]->tBranchParent ;
+                if ( parent == nullptr ) {
+                    state.dt = 0 ;
                 }
                 else {
-                    newNode->dt = newNode->t - phyloParent->t ;
-                    assert( newNode->t >= phyloParent->t ) ;
+                    state.dt = state.t - parent->t ;
+                    assert( state.t >= parent->t ) ;
                 }
                 
-                if ( newNode->depth < nChildren - 1 ) { // attach child + internal node
+                if ( state.depth < nChildren - 1 ) { // attach child + internal node
                     
-                    auto& child = children_sorted[ newNode->depth ] ;
-                    newNode->leftChild  = getAncestralTree( child, newNode ) ;
-                    newNode->rightChild = getAncestralTree( node, newNode ) ;
+                    auto& child = children_sorted[ state.depth ] ;
+                    left  = child ;
+                    right = node ;
                        
                 }
                 else { // add last child and sampled node
  
-                    auto& child = children_sorted[ newNode->depth ] ;
+                    auto& child = children_sorted[ state.depth ] ;
                     
-                    // create sampled ancestor node (a leaf)
-                    PhyloNode<T,U>* sampledNode = new PhyloNode<T,U>( node->lng, newNode ) ;
-                    sampledNode->t = node->tSample ;
-                    sampledNode->dt = node->tSample - children_sorted[ newNode->depth ]->tBranchParent ;
-                    sampledNode->depth = newNode->depth + 1 ;
-                    sampledNode->data = node->data ;
-                    sampledNode->locSample = node->locSample ; // only for sampled nodes
-                    sampledNode->leftChild = nullptr ;
-                    sampledNode->rightChild = nullptr ;
-
-                    newNode->leftChild  = getAncestralTree( child, newNode ) ;
-                    newNode->rightChild  = sampledNode ;
+                    // sampled ancestor node (a leaf)
+                    sampledLeaf = true ;
+                    dtSampled = node->tSample - children_sorted[ state.depth ]->tBranchParent ;
+
+                    left  = child ;
                     
                 }
                 
@@ -1097,45 +3493,344 @@ PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U>* node, PhyloNode<T,U>* ph
             
             assert( nChildren >= 2 ) ; // node must have at least two children (otherwise it would have been removed already)
 
-            bool isLastEvent = ( newNode->depth == nChildren ) ? true : false ;
+            bool isLastEvent = ( state.depth == nChildren ) ? true : false ;
             assert( !isLastEvent ) ; // we should never get to this point
+            (void) isLastEvent ;
             
-            newNode->t = children_sorted[ newNode->depth ]->tBranchParent ;
-            if ( phyloParent == nullptr )
-                newNode->dt = 0 ;
+            state.t = children_sorted[ state.depth ]->tBranchParent ;
+            if ( parent == nullptr )
+                state.dt = 0 ;
             else {
-                newNode->dt = newNode->t - phyloParent->t ;
-                assert( newNode->t >= phyloParent->t ) ;
+                state.dt = state.t - parent->t ;
+                assert( state.t >= parent->t ) ;
             }
 
-            if ( newNode->depth < nChildren - 2 ) { // recurse down
+            if ( state.depth < nChildren - 2 ) { // recurse down
                 
-                auto& child = children_sorted[ newNode->depth ] ;
+                auto& child = children_sorted[ state.depth ] ;
                 //newNode->depthChild += 1 ;
-                newNode->leftChild  = getAncestralTree( child, newNode ) ;
-                newNode->rightChild = getAncestralTree( node,  newNode ) ;
+                left  = child ;
+                right = node ;
                 
             }
             else { // stop recursion: last cherry in the tree
                 
-                auto& child1 = children_sorted[ newNode->depth ] ;
-                auto& child2 = children_sorted[ newNode->depth + 1 ] ;
+                auto& child1 = children_sorted[ state.depth ] ;
+                auto& child2 = children_sorted[ state.depth + 1 ] ;
+
+                left  = child1 ;
+                right = child2 ;
+                
+            }
+            
+            
+        }
+        
+        
+    }
+    
+    return sampledLeaf ;
+    
+}
+
+/*
+ 
+ Creates the phylogenetic node of 'node' below 'phyloParent'
+ (one step of 'getAncestralTree', see 'ancestralStep').
+ 
+ */
+
+template <typename T, typename U, class Hash>
+PhyloNode<T,U>* makeAncestralNode( LineageTreeNode<T,U,Hash>* node, PhyloNode<T,U>* phyloParent, LineageTreeNode<T,U,Hash>*& left, LineageTreeNode<T,U,Hash>*& right ) {
+
+    AncestralState<T> parentState, state ;
+    if ( phyloParent != nullptr )
+        parentState = AncestralState<T>{ &phyloParent->lng, phyloParent->depth, phyloParent->depthChild, phyloParent->depthAttachSampledNode, phyloParent->t, phyloParent->dt } ;
+    
+    double dtSampled = 0. ;
+    bool sampledLeaf = ancestralStep( node, ( phyloParent != nullptr ) ? &parentState : nullptr, state, left, right, dtSampled ) ;
+    
+    // create phylo node (internal or tip)
+    PhyloNode<T,U>* newNode = new PhyloNode<T,U>( node->lng, phyloParent ) ;
+    newNode->data = node->data ;
+    newNode->depth = state.depth ;
+    newNode->depthChild = state.depthChild ;
+    newNode->depthAttachSampledNode = state.depthAttachSampledNode ;
+    newNode->t  = state.t ;
+    newNode->dt = state.dt ;
+    if ( node->children.empty() ) // sampled leaf
+        newNode->locSample = node->locSample ;
+    
+    if ( sampledLeaf ) { // create sampled ancestor node (a leaf)
+        
+        PhyloNode<T,U>* sampledNode = new PhyloNode<T,U>( node->lng, newNode ) ;
+        sampledNode->t = node->tSample ;
+        sampledNode->dt = dtSampled ;
+        sampledNode->depth = newNode->depth + 1 ;
+        sampledNode->data = node->data ;
+        sampledNode->locSample = node->locSample ; // only for sampled nodes
+        newNode->rightChild = sampledNode ;
+        
+    }
+    
+    return newNode ;
+    
+}
+
+/*
+ 
+ Pending step of 'getAncestralTree': creates the phylogenetic node of
+ 'node' below 'phyloParent' and stores it in '*result'.
+ 
+ */
+
+template <typename T, typename U, class Hash>
+struct AncestralTask {
+    
+    LineageTreeNode<T,U,Hash>* node ;
+    PhyloNode<T,U>* phyloParent ;
+    PhyloNode<T,U>** result ; // where to store the new node
+    
+} ;
+
+/*
+ 
+ Runs the pending 'tasks' of 'getAncestralTree' and those they spawn.
+ Tasks whose node satisfies 'defer( node )' are moved to 'deferred'
+ instead, to be run later by another call (see 'extractForest').
+ 
+ */
+
+template <typename T, typename U, class Hash, class Defer>
+void runAncestralTasks( std::vector<AncestralTask<T,U,Hash>>& tasks, Defer defer, std::vector<AncestralTask<T,U,Hash>>& deferred ) {
+    
+    typedef AncestralTask<T,U,Hash> Task ;
+    
+    while ( !tasks.empty() ) {
+        
+        Task task = tasks.back() ;
+        tasks.pop_back() ;
+        
+        if ( defer( task.node ) ) {
+            deferred.push_back( task ) ;
+            continue ;
+        }
+        
+        LineageTreeNode<T,U,Hash>* left  = nullptr ;
+        LineageTreeNode<T,U,Hash>* right = nullptr ;
+        PhyloNode<T,U>* newNode = makeAncestralNode( task.node, task.phyloParent, left, right ) ;
+        *task.result = newNode ;
+        
+        if ( right != nullptr ) // pushed first, processed last
+            tasks.push_back( Task{ right, newNode, &newNode->rightChild } ) ;
+        if ( left != nullptr )
+            tasks.push_back( Task{ left, newNode, &newNode->leftChild } ) ;
+        
+    }
+    
+}
+
+/*
+ 
+ Returns a phylogenetic tree from a reduced transmission tree.
+ 
+ 'node' can be any node in the reduced transmission tree, but
+ the complete phylogenetic tree is returned by calling the
+ function on the root node of the reduced transmission tree.
+ 
+ Downstream nodes are processed iteratively from a stack of pending
+ tasks (see 'makeAncestralNode' and 'runAncestralTasks'), left subtrees first.
+ 
+ In the resulting tree, sampled lineages appear as leaf nodes,
+ while internal nodes correspond to past infection events.
+ However, it may also happen that some ancestral lineages are also leaves.
+ This might happen if we manage to sample the parent of a lineage.
+ 
+ */
+
+
+template <typename T, typename U, class Hash>
+PhyloNode<T,U>* getAncestralTree( LineageTreeNode<T,U,Hash>* node, PhyloNode<T,U>* phyloParent = nullptr ) {
+
+    if ( node == nullptr )
+        return nullptr ;
+    
+    TREE_STATS_UPDATE(
+        ++ancestralTreeStats().calls ;
+        ScopedStatsTimer timer( ancestralTreeStats().nanoseconds ) ;
+    )
+    
+    PhyloNode<T,U>* root = nullptr ;
+    std::vector<AncestralTask<T,U,Hash>> tasks, deferred ;
+    tasks.push_back( AncestralTask<T,U,Hash>{ node, phyloParent, &root } ) ;
+    runAncestralTasks( tasks, []( LineageTreeNode<T,U,Hash>* ) { return false ; }, deferred ) ;
+    
+    return root ;
+    
+}
+
+
+//====== Flat phylogenies ======//
+
+/*
+ 
+ Phylogenetic tree stored as parallel arrays indexed by node, in preorder:
+ the root is node 0, and each node comes before its left subtree, itself
+ before its right subtree (hence every subtree is a contiguous range).
+ Same nodes as 'PhyloNode' trees (see 'getAncestralTree'), without a heap
+ allocation per node: large trees are built and traversed sequentially,
+ freed at once, and arrays are reused by later trees ('clear' keeps them).
+ 
+ 'PHYLO_NONE' plays the role of 'nullptr' for indices. 'sampledAncestor'
+ flags the leaves of sampled lineages that also have descendants (see
+ "A note on sampled ancestors" in the README).
+ 
+ */
+
+const uint32_t PHYLO_NONE = 0xFFFFFFFF ;
+
+template <typename T, typename U>
+struct FlatPhylogeny {
+    
+    std::vector<uint32_t> parent ;
+    std::vector<uint32_t> leftChild ;
+    std::vector<uint32_t> rightChild ;
+    std::vector<double> t ; // node time (infection time if internal, sampling time if leaf)
+    std::vector<double> dt ; // branch length (wrt parent)
+    std::vector<T> lng ; // lineage identity
+    std::vector<U> data ; // extra data
+    std::vector<LocationID> locSample ; // sampling location (NA if internal)
+    std::vector<uint32_t> depth ; // see 'PhyloNode'
+    std::vector<uint8_t> sampledAncestor ;
+    
+    std::size_t size() const { return parent.size() ; }
+    bool empty() const { return parent.empty() ; }
+    bool isLeaf( uint32_t node ) const { return leftChild[node] == PHYLO_NONE ; }
+    
+    void clear() { // keeps capacity
+        
+        parent.clear() ; leftChild.clear() ; rightChild.clear() ;
+        t.clear() ; dt.clear() ; lng.clear() ; data.clear() ;
+        locSample.clear() ; depth.clear() ; sampledAncestor.clear() ;
+        
+    }
+    
+    /*
+     Resizes all arrays to 'n' nodes (new nodes have no links).
+     */
+    void resize( std::size_t n ) {
+        
+        assert( n < PHYLO_NONE ) ;
+        parent.resize( n, PHYLO_NONE ) ; leftChild.resize( n, PHYLO_NONE ) ; rightChild.resize( n, PHYLO_NONE ) ;
+        t.resize( n ) ; dt.resize( n ) ; lng.resize( n ) ; data.resize( n ) ;
+        locSample.resize( n, LOCATION_NA ) ; depth.resize( n ) ; sampledAncestor.resize( n ) ;
+        
+    }
+    
+} ;
+
+/*
+ Children accessor of 'FlatPhylogeny' trees (see 'traverseDepthFirst').
+ */
+
+template <typename T, typename U>
+struct FlatPhylogenyChildren {
+    
+    const FlatPhylogeny<T,U>& tree ;
+    std::size_t nChildren( uint32_t node ) const { return ( tree.leftChild[node] != PHYLO_NONE ) + ( tree.rightChild[node] != PHYLO_NONE ) ; }
+    uint32_t child( uint32_t node, std::size_t i ) const { return ( i == 0 and tree.leftChild[node] != PHYLO_NONE ) ? tree.leftChild[node] : tree.rightChild[node] ; }
+    
+} ;
 
-                newNode->leftChild  = getAncestralTree( child1, newNode ) ;
-                newNode->rightChild = getAncestralTree( child2, newNode ) ;
-                
-            }
+/*
+ 
+ Stores in 'tree' the phylogenetic tree of reduced transmission tree 'node'
+ (empty if 'node' is 'nullptr'): same tree as 'getAncestralTree( node )',
+ with nodes in preorder (see 'FlatPhylogeny'). Nodes are appended as they
+ are created, from the same stack of pending steps (see 'ancestralStep').
+ 
+ */
+
+template <typename T, typename U, class Hash>
+void getAncestralTree( LineageTreeNode<T,U,Hash>* node, FlatPhylogeny<T,U>& tree ) {
+    
+    tree.clear() ;
+    if ( node == nullptr )
+        return ;
+    
+    TREE_STATS_UPDATE(
+        ++ancestralTreeStats().calls ;
+        ScopedStatsTimer timer( ancestralTreeStats().nanoseconds ) ;
+    )
+    
+    struct Task {
+        LineageTreeNode<T,U,Hash>* node ;
+        uint32_t parent ; // index of the parent (PHYLO_NONE for the root)
+        bool right ; // right child of 'parent'
+        bool sampledLeaf ; // leaf of sampled ancestor 'node' (with branch length 'dtSampled')
+        double dtSampled ;
+        AncestralState<T> parentState ;
+    } ;
+    
+    tree.resize( std::max<std::size_t>( tree.parent.capacity(), 1024 ) ) ; // grown geometrically, trimmed at the end
+    uint32_t nnodes = 0 ;
+    
+    std::vector<Task> tasks ;
+    tasks.push_back( Task{ node, PHYLO_NONE, false, false, 0., AncestralState<T>() } ) ;
+    
+    while ( !tasks.empty() ) {
+        
+        Task task = tasks.back() ;
+        tasks.pop_back() ;
+        
+        uint32_t newNode = nnodes++ ;
+        if ( newNode == tree.size() )
+            tree.resize( 2 * tree.size() ) ;
+        tree.parent[newNode] = task.parent ;
+        if ( task.parent != PHYLO_NONE )
+            ( task.right ? tree.rightChild : tree.leftChild )[task.parent] = newNode ;
+        tree.lng[newNode] = task.node->lng ;
+        tree.data[newNode] = task.node->data ;
+        
+        if ( task.sampledLeaf ) {
             
+            tree.t[newNode] = task.node->tSample ;
+            tree.dt[newNode] = task.dtSampled ;
+            tree.depth[newNode] = task.parentState.depth + 1 ;
+            tree.locSample[newNode] = task.node->locSample ;
+            tree.sampledAncestor[newNode] = 1 ;
+            continue ;
             
         }
         
+        LineageTreeNode<T,U,Hash>* left  = nullptr ;
+        LineageTreeNode<T,U,Hash>* right = nullptr ;
+        AncestralState<T> state ;
+        double dtSampled = 0. ;
+        bool sampledLeaf = ancestralStep( task.node, ( task.parent != PHYLO_NONE ) ? &task.parentState : nullptr, state, left, right, dtSampled ) ;
+        
+        tree.t[newNode] = state.t ;
+        tree.dt[newNode] = state.dt ;
+        tree.depth[newNode] = state.depth ;
+        if ( task.node->children.empty() ) // sampled leaf
+            tree.locSample[newNode] = task.node->locSample ;
+        
+        if ( sampledLeaf ) // pushed first, processed last (right child)
+            tasks.push_back( Task{ task.node, newNode, true, true, dtSampled, state } ) ;
+        else if ( right != nullptr )
+            tasks.push_back( Task{ right, newNode, true, false, 0., state } ) ;
+        if ( left != nullptr )
+            tasks.push_back( Task{ left, newNode, false, false, 0., state } ) ;
         
     }
     
-    return newNode ;
+    tree.resize( nnodes ) ;
     
 }
 
+
+//====== Writers ======//
+
 /*
  
  Converts 'lng' to string.
@@ -1166,50 +3861,251 @@ std::string data2string( PhyloNode<T,U>* node ) {
     
 }
 
+/*
+ 
+ Options of the Newick and NHX writers: times and branch lengths are
+ written with 'precision' decimals (6 by default, as 'std::to_string'),
+ or with the shortest representation that reads back as the same double
+ if 'precision' is negative (see 'shortest' and 'number_format.hpp').
+ 
+ */
+
+struct NewickFormat {
+    
+    explicit NewickFormat( int precision = 6 ): precision( precision ) { assert( precision <= MAX_FIXED_PRECISION ) ; } ;
+    static NewickFormat shortest() { return NewickFormat( -1 ) ; }
+    
+    int precision ;
+    
+} ;
 
 /*
- Yields a phylogenetic tree in NHX format
+ 
+ Appends 'value' to 'out' as 'lng2string' would: integers are formatted
+ in place (see 'formatInteger'), strings copied, other types go through '<<'.
+ 
  */
 
-template <typename T, typename U>
-std::string getNHX( PhyloNode<T,U>* root ) {
+template <typename V>
+typename std::enable_if<IsDecimalInteger<V>::value>::type appendValue( std::string& out, const V& value ) {
     
-    std::string nhx ; // holds result
-    PhyloNode2NHX( nhx, root ) ; // begin recursion
-    nhx += ";" ; // closing character
+    char buffer[24] ;
+    out.append( buffer, formatInteger( buffer, value ) ) ;
     
-    return nhx ;
+}
+
+template <typename V>
+typename std::enable_if<!IsDecimalInteger<V>::value>::type appendValue( std::string& out, const V& value ) {
+    
+    out += lng2string( value ) ;
+    
+}
+
+inline void appendValue( std::string& out, const std::string& value ) { out += value ; }
+
+inline void appendNumber( std::string& out, double x, const NewickFormat& format ) {
+    
+    char buffer[NUMBER_BUFFER_SIZE] ;
+    out.append( buffer, ( format.precision < 0 ) ? formatShortest( buffer, x ) : formatFixed( buffer, x, format.precision ) ) ;
     
 }
 
 /*
-Recursive function to build a phylogenetic tree in NHX format
+ 
+ Fields of the nodes of phylogenetic trees, as read by 'NewickWriter':
+ 'PhyloNode' trees and 'FlatPhylogeny' trees.
+ 
  */
 
 template <typename T, typename U>
-void PhyloNode2NHX( std::string& nhx, PhyloNode<T,U>* node ) {
+struct PhyloNodeFields {
+    
+    typedef PhyloNode<T,U>* Node ;
+    PhyloNodeChildren children() const { return PhyloNodeChildren() ; }
+    bool isLeaf( Node node ) const { return node->leftChild == nullptr ; }
+    const T& lng( Node node ) const { return node->lng ; }
+    const U& data( Node node ) const { return node->data ; }
+    double t( Node node ) const { return node->t ; }
+    double dt( Node node ) const { return node->dt ; }
+    uint depth( Node node ) const { return node->depth ; }
+    LocationID locSample( Node node ) const { return node->locSample ; }
+    
+} ;
+
+template <typename T, typename U>
+struct FlatPhylogenyFields {
+    
+    typedef uint32_t Node ;
+    const FlatPhylogeny<T,U>& tree ;
+    FlatPhylogenyChildren<T,U> children() const { return FlatPhylogenyChildren<T,U>{ tree } ; }
+    bool isLeaf( Node node ) const { return tree.isLeaf( node ) ; }
+    const T& lng( Node node ) const { return tree.lng[node] ; }
+    const U& data( Node node ) const { return tree.data[node] ; }
+    double t( Node node ) const { return tree.t[node] ; }
+    double dt( Node node ) const { return tree.dt[node] ; }
+    uint depth( Node node ) const { return tree.depth[node] ; }
+    LocationID locSample( Node node ) const { return tree.locSample[node] ; }
+    
+} ;
+
+/*
+ 
+ Visitor writing a phylogenetic tree in Newick format (see 'traverseDepthFirst'),
+ with NHX metadata if 'nhx' is 'true'. Sampling locations are appended to the
+ metadata only if 'locations' is set (location IDs are resolved here).
+ Labels and numbers are formatted straight into 'out' (see 'appendValue'
+ and 'appendNumber'), without temporary strings.
+ 
+ 'open' tracks, for each internal node on the current path, whether one of its
+ children has been written already (i.e. whether a separator is due).
+ 
+ Subtrees listed in 'splices' (if set) are not visited: the text given for
+ them, written beforehand by another writer, is copied instead.
+ 
+ */
+
+template <class Fields>
+struct NewickWriter {
+    
+    typedef typename Fields::Node Node ;
+    
+    Fields fields ;
+    std::string& out ;
+    bool nhx ;
+    const LocationDictionary* locations ;
+    NewickFormat format ;
+    const FlatHashMap<Node, const std::string*>* splices ;
+    std::vector<bool> open ;
+    bool spliced ; // true if the last node entered was copied from 'splices'
     
-    bool isLeaf = ( node->leftChild == nullptr ) ? true : false ;
+    void writeMetadata( Node node ) {
+        
+        out += "[&&NHX:" ;
+        appendValue( out, fields.data( node ) ) ;
+        out += ':' ;
+        appendNumber( out, fields.t( node ), format ) ;
+        if ( locations != nullptr ) {
+            out += ':' ;
+            out += locations->name( fields.locSample( node ) ) ;
+        }
+        out += ']' ;
+        
+    }
     
-    if ( isLeaf ) {
+    bool enter( Node node ) {
+        
+        if ( !open.empty() ) {
+            if ( open.back() )
+                out += ',' ;
+            open.back() = true ;
+        }
+        
+        if ( splices != nullptr ) {
+            const std::string* const* text = splices->find( node ) ;
+            if ( text != nullptr ) {
+                out += **text ;
+                spliced = true ;
+                return false ;
+            }
+        }
+        
+        if ( fields.isLeaf( node ) ) {
+            
+            appendValue( out, fields.lng( node ) ) ;
+            out += ':' ;
+            appendNumber( out, fields.dt( node ), format ) ;
+            if ( nhx )
+                writeMetadata( node ) ;
+            return false ;
+            
+        }
         
-        nhx += lng2string( node->lng ) + ":" + std::to_string( node->dt ) ;
-        nhx += "[&&NHX:" + data2string( node ) + ":" + std::to_string( node->t ) + "]";
+        // manage branching event
+        out += '(' ;
+        open.push_back( false ) ;
+        return true ;
         
     }
-    else { // manage branching event
+    
+    void leave( Node node ) {
+        
+        if ( spliced ) { // already written
+            spliced = false ;
+            return ;
+        }
+        
+        if ( fields.isLeaf( node ) ) // leaf (already written)
+            return ;
         
-        nhx += "(" ;
-        PhyloNode2NHX( nhx, node->leftChild ) ;
-        nhx += "," ;
-        PhyloNode2NHX( nhx, node->rightChild ) ;
-        nhx += ")" ;
-        nhx += lng2string( node->lng ) + "-" + std::to_string( node->depth ) ;
-        nhx += ":" + std::to_string( node->dt ) ;
-        nhx += "[&&NHX:" + data2string( node ) + ":" + std::to_string( node->t ) + "]";
+        open.pop_back() ;
+        out += ')' ;
+        appendValue( out, fields.lng( node ) ) ;
+        out += '-' ;
+        appendValue( out, fields.depth( node ) ) ;
+        out += ':' ;
+        appendNumber( out, fields.dt( node ), format ) ;
+        if ( nhx )
+            writeMetadata( node ) ;
+        
+    }
+    
+} ;
 
+template <typename T, typename U>
+using PhyloNodeWriter = NewickWriter<PhyloNodeFields<T,U>> ;
 
-    }
+/*
+ 
+ Writes the tree below 'node' to 'out' (see 'NewickWriter'), after
+ reserving room for 'nnodes' nodes (if known) at once.
+ 
+ */
+
+template <class Fields>
+void writeNewick( std::string& out, const Fields& fields, typename Fields::Node node, bool nhx, const LocationDictionary* locations, const NewickFormat& format, std::size_t nnodes = 0 ) {
+    
+    const std::size_t bytesPerNode = nhx ? 40 : 16 ; // typical, with 6 decimals
+    out.reserve( out.size() + nnodes * bytesPerNode + 1 ) ;
+    
+    NewickWriter<Fields> writer{ fields, out, nhx, locations, format, nullptr, {}, false } ;
+    traverseDepthFirst( node, fields.children(), writer ) ;
+    
+}
+
+/*
+ Yields a phylogenetic tree in NHX format.
+ 
+ If 'locations' is given (see 'LineageTree::getLocations'), the sampling
+ location of each node is added to its metadata ("NA" for internal nodes).
+ Numbers are written as set by 'format' (see 'NewickFormat').
+ */
+
+template <typename T, typename U>
+std::string getNHX( PhyloNode<T,U>* root, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    std::string nhx ; // holds result
+    PhyloNode2NHX( nhx, root, locations, format ) ;
+    nhx += ";" ; // closing character
+    
+    return nhx ;
+    
+}
+
+template <typename T, typename U>
+std::string getNHX( PhyloNode<T,U>* root, const LocationDictionary& locations, const NewickFormat& format = NewickFormat() ) {
+    
+    return getNHX( root, &locations, format ) ;
+    
+}
+
+/*
+ Appends the phylogenetic tree below 'node' to 'nhx' in NHX format
+ */
+
+template <typename T, typename U>
+void PhyloNode2NHX( std::string& nhx, PhyloNode<T,U>* node, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    writeNewick( nhx, PhyloNodeFields<T,U>(), node, true, locations, format ) ;
     
 }
 
@@ -1218,10 +4114,10 @@ void PhyloNode2NHX( std::string& nhx, PhyloNode<T,U>* node ) {
  */
 
 template <typename T, typename U>
-std::string getSimpleNewick( PhyloNode<T,U>* root ) {
+std::string getSimpleNewick( PhyloNode<T,U>* root, const NewickFormat& format = NewickFormat() ) {
     
     std::string nhx ; // holds result
-    PhyloNode2Newick( nhx, root ) ; // begin recursion
+    PhyloNode2Newick( nhx, root, format ) ;
     nhx += ";" ; // closing character
     
     return nhx ;
@@ -1229,32 +4125,309 @@ std::string getSimpleNewick( PhyloNode<T,U>* root ) {
 }
 
 /*
-Recursive function to build a phylogenetic tree in NHX format
+ Appends the phylogenetic tree below 'node' to 'nhx' in Newick format
+ */
+
+template <typename T, typename U>
+void PhyloNode2Newick( std::string& nhx, PhyloNode<T,U>* node, const NewickFormat& format = NewickFormat() ) {
+    
+    writeNewick( nhx, PhyloNodeFields<T,U>(), node, false, nullptr, format ) ;
+    
+}
+
+/*
+ Same as above for 'FlatPhylogeny' trees (empty trees yield ";"), whose
+ size is known, hence the output is reserved at once.
  */
 
 template <typename T, typename U>
-void PhyloNode2Newick( std::string& nhx, PhyloNode<T,U>* node ) {
+std::string getNHX( const FlatPhylogeny<T,U>& tree, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    std::string nhx ;
+    if ( !tree.empty() )
+        writeNewick( nhx, FlatPhylogenyFields<T,U>{ tree }, 0, true, locations, format, tree.size() ) ;
+    nhx += ";" ;
+    
+    return nhx ;
+    
+}
+
+template <typename T, typename U>
+std::string getNHX( const FlatPhylogeny<T,U>& tree, const LocationDictionary& locations, const NewickFormat& format = NewickFormat() ) {
+    
+    return getNHX( tree, &locations, format ) ;
+    
+}
+
+template <typename T, typename U>
+std::string getSimpleNewick( const FlatPhylogeny<T,U>& tree, const NewickFormat& format = NewickFormat() ) {
+    
+    std::string nwk ;
+    if ( !tree.empty() )
+        writeNewick( nwk, FlatPhylogenyFields<T,U>{ tree }, 0, false, nullptr, format, tree.size() ) ;
+    nwk += ";" ;
+    
+    return nwk ;
+    
+}
+
+
+//====== Streaming writers ======//
+
+/*
+ 
+ Writes trees to a 'TextSink' (a stream, a file or a file descriptor,
+ possibly gzip-compressed: see 'text_sink.hpp') instead of returning
+ strings, hence in bounded memory whatever the size of the trees:
+ 
+    FileSink file ;
+    if ( file.open( "tree.nwk" ) )
+        writeSimpleNewick( file, atree.get() ) ;
+ 
+ The text is the same as that of 'getSimpleNewick' and 'getNHX'. It is
+ formatted in a buffer of about 'STREAM_CHUNK_SIZE' bytes, which is handed
+ to the sink whenever full. Writers return 'false' if the sink failed.
+ 
+ */
+
+const std::size_t STREAM_CHUNK_SIZE = 1 << 16 ;
+
+/*
+ Visitor wrapping a 'NewickWriter', which spills its output to 'sink' whenever it holds 'STREAM_CHUNK_SIZE' bytes.
+ */
+
+template <class Fields>
+struct StreamingNewickWriter {
+    
+    typedef typename Fields::Node Node ;
+    
+    NewickWriter<Fields> writer ;
+    TextSink& sink ;
+    
+    bool enter( Node node ) {
+        
+        bool res = writer.enter( node ) ;
+        spill() ;
+        return res ;
+        
+    }
     
-    bool isLeaf = ( node->leftChild == nullptr ) ? true : false ;
+    void leave( Node node ) {
+        
+        writer.leave( node ) ;
+        spill() ;
+        
+    }
     
-    if ( isLeaf ) {
+    void spill() {
         
-        nhx += lng2string( node->lng ) + ":" + std::to_string( node->dt ) ;
+        if ( writer.out.size() >= STREAM_CHUNK_SIZE ) {
+            sink.writeString( writer.out ) ;
+            writer.out.clear() ; // keeps its capacity
+        }
         
     }
-    else { // manage branching event
+    
+} ;
+
+/*
+ Writes the tree below 'node' to 'sink', followed by ";" and 'end' (e.g. a new line).
+ */
+
+template <class Fields>
+bool streamNewick( TextSink& sink, const Fields& fields, typename Fields::Node node, bool nhx, const LocationDictionary* locations, const NewickFormat& format, const char* end = "" ) {
+    
+    std::string buffer ;
+    buffer.reserve( STREAM_CHUNK_SIZE + 1024 ) ;
+    
+    StreamingNewickWriter<Fields> writer{ NewickWriter<Fields>{ fields, buffer, nhx, locations, format, nullptr, {}, false }, sink } ;
+    traverseDepthFirst( node, fields.children(), writer ) ;
+    
+    buffer += ';' ;
+    buffer += end ;
+    sink.writeString( buffer ) ;
+    return sink.good() ;
+    
+}
+
+/*
+ Writes a phylogenetic tree to 'sink' in Newick format (see 'getSimpleNewick')
+ */
+
+template <typename T, typename U>
+bool writeSimpleNewick( TextSink& sink, PhyloNode<T,U>* root, const NewickFormat& format = NewickFormat() ) {
+    
+    return streamNewick( sink, PhyloNodeFields<T,U>(), root, false, nullptr, format ) ;
+    
+}
+
+template <typename T, typename U>
+bool writeSimpleNewick( TextSink& sink, const FlatPhylogeny<T,U>& tree, const NewickFormat& format = NewickFormat() ) {
+    
+    if ( tree.empty() ) {
+        sink.writeString( ";" ) ;
+        return sink.good() ;
+    }
+    return streamNewick( sink, FlatPhylogenyFields<T,U>{ tree }, 0, false, nullptr, format ) ;
+    
+}
+
+/*
+ Writes a phylogenetic tree to 'sink' in NHX format (see 'getNHX')
+ */
+
+template <typename T, typename U>
+bool writeNHX( TextSink& sink, PhyloNode<T,U>* root, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    return streamNewick( sink, PhyloNodeFields<T,U>(), root, true, locations, format ) ;
+    
+}
+
+template <typename T, typename U>
+bool writeNHX( TextSink& sink, const FlatPhylogeny<T,U>& tree, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    if ( tree.empty() ) {
+        sink.writeString( ";" ) ;
+        return sink.good() ;
+    }
+    return streamNewick( sink, FlatPhylogenyFields<T,U>{ tree }, 0, true, locations, format ) ;
+    
+}
+
+/*
+ 
+ Writes the phylogenetic trees of reduced trees 'first' to 'last' (e.g. from
+ 'subSampleTree'), one per line, in Newick format (NHX if 'nhx' is 'true',
+ with sampling locations if 'locations' is set). Trees are converted one at
+ a time into the same 'FlatPhylogeny', hence only one phylogenetic tree
+ is held in memory. Returns 'false' if the sink failed.
+ 
+    writeForest( file, ReducedForest<int,int>( tree_mngr->subSampleTree() ) ) ;
+ 
+ */
+
+template <typename T, typename U, class Hash, class Iterator>
+bool writeForest( TextSink& sink, Iterator first, Iterator last, bool nhx = false, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    FlatPhylogeny<T,U> flat ;
+    for ( ; first != last and sink.good(); ++first ) {
+        
+        LineageTreeNode<T,U,Hash>* rtree = *first ;
+        getAncestralTree( rtree, flat ) ;
+        if ( flat.empty() )
+            sink.writeString( ";\n" ) ;
+        else
+            streamNewick( sink, FlatPhylogenyFields<T,U>{ flat }, 0, nhx, locations, format, "\n" ) ;
         
-        nhx += "(" ;
-        PhyloNode2Newick( nhx, node->leftChild ) ;
-        nhx += "," ;
-        PhyloNode2Newick( nhx, node->rightChild ) ;
-        nhx += ")" ;
-        nhx += lng2string( node->lng ) + "-" + std::to_string( node->depth ) ;
-        nhx += ":" + std::to_string( node->dt ) ;
+    }
+    
+    return sink.good() ;
+    
+}
+
+template <typename T, typename U, class Hash>
+bool writeForest( TextSink& sink, const ReducedForest<T,U,Hash>& forest, bool nhx = false, const LocationDictionary* locations = nullptr, const NewickFormat& format = NewickFormat() ) {
+    
+    return writeForest<T,U,Hash>( sink, forest.begin(), forest.end(), nhx, locations, format ) ;
+    
+}
+
 
+//====== Parallel extraction ======//
 
+/*
+ 
+ Reduces, converts and writes all trees of 'tree' on 'nthreads' threads.
+ Returns the Newick strings (NHX if 'nhx' is 'true', with sampling
+ locations if 'locations' is set) of the trees, identical to those of
+ the serial pipeline and in the same order:
+ 
+    for ( LineageTreeNode<T,U,Hash>* rtree : tree.subSampleTree() )
+        getNHX( getAncestralTree( rtree ), locations ) ; // or getSimpleNewick
+ 
+ Each chain is processed as a task, and chains with more than 'grain'
+ sampled lineages are split in subtree tasks (see 'subSampleTree( nthreads )'),
+ which are then converted and written separately too, before the top parts
+ of the trees. Intermediate trees are freed (also concurrently).
+ 
+ */
+
+template <typename T, typename U, class Hash, class Index, class Layout>
+std::vector<std::string> extractForest( LineageTree<T,U,Hash,Index,Layout>& tree, unsigned nthreads, bool nhx = false, const LocationDictionary* locations = nullptr, std::size_t grain = 4096 ) {
+    
+    typedef LineageTreeNode<T,U,Hash> Node ;
+    typedef PhyloNode<T,U> Phylo ;
+    typedef AncestralTask<T,U,Hash> Task ;
+    
+    // reduce
+    std::vector<Node*> cuts ;
+    std::vector<Node*> rtrees = tree.subSampleTree( nthreads, grain, &cuts ) ;
+    
+    FlatHashSet<Node*> isCut ;
+    for ( Node* cut : cuts )
+        isCut.insert( cut ) ;
+    
+    // convert: top parts first, subtrees of cuts deferred
+    std::vector<Phylo*> atrees( rtrees.size(), nullptr ) ;
+    std::vector<std::vector<Task>> deferred( rtrees.size() ) ;
+    parallelFor( rtrees.size(), nthreads, [&]( std::size_t i ) {
+        std::vector<Task> tasks( 1, Task{ rtrees[i], nullptr, &atrees[i] } ) ;
+        runAncestralTasks( tasks, [&]( Node* node ) { return isCut.contains( node ) ; }, deferred[i] ) ;
+    } ) ;
+    
+    std::vector<Task> pieces ;
+    for ( const std::vector<Task>& tasks : deferred )
+        pieces.insert( pieces.end(), tasks.begin(), tasks.end() ) ;
+    
+    parallelFor( pieces.size(), nthreads, [&]( std::size_t k ) {
+        std::vector<Task> tasks( 1, pieces[k] ), none ;
+        runAncestralTasks( tasks, []( Node* ) { return false ; }, none ) ;
+    } ) ;
+    
+    // write: subtrees first, then top parts
+    std::vector<std::string> texts( pieces.size() ) ;
+    parallelFor( pieces.size(), nthreads, [&]( std::size_t k ) {
+        PhyloNodeWriter<T,U> writer{ PhyloNodeFields<T,U>(), texts[k], nhx, locations, NewickFormat(), nullptr, {}, false } ;
+        traverseDepthFirst( *pieces[k].result, PhyloNodeChildren(), writer ) ;
+    } ) ;
+    
+    FlatHashMap<Phylo*, const std::string*> splices ;
+    for ( std::size_t k = 0; k < pieces.size(); ++k )
+        splices.insert( *pieces[k].result, &texts[k] ) ;
+    
+    std::vector<std::string> res( rtrees.size() ) ;
+    parallelFor( rtrees.size(), nthreads, [&]( std::size_t i ) {
+        PhyloNodeWriter<T,U> writer{ PhyloNodeFields<T,U>(), res[i], nhx, locations, NewickFormat(), &splices, {}, false } ;
+        traverseDepthFirst( atrees[i], PhyloNodeChildren(), writer ) ;
+        res[i] += ";" ; // closing character
+    } ) ;
+    
+    // free: detach subtrees, then free all parts
+    std::vector<Phylo*> aparts( atrees ) ;
+    for ( const Task& piece : pieces ) {
+        if ( piece.phyloParent != nullptr ) { // else root of a tree
+            aparts.push_back( *piece.result ) ;
+            *piece.result = nullptr ;
+        }
+    }
+    
+    std::vector<Node*> rparts( rtrees ) ;
+    for ( Node* cut : cuts ) {
+        if ( cut->parent != nullptr ) { // else root of a tree
+            cut->parent->eraseChild( cut ) ;
+            rparts.push_back( cut ) ;
+        }
     }
     
+    parallelFor( aparts.size() + rparts.size(), nthreads, [&]( std::size_t k ) {
+        if ( k < aparts.size() )
+            deletePhyloNodeTree( aparts[k] ) ;
+        else
+            deleteLineageTreeNodeTree( rparts[k - aparts.size()] ) ;
+    } ) ;
+    
+    return res ;
+    
 }
 
 #endif /* tree_h */